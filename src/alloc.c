@@ -0,0 +1,174 @@
+#include "matrix.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define HUGE_PAGE_SIZE (2ul << 20)
+// Note: smaller allocations come from heap, larger ones are mapped and prefaulted
+#define MAP_THRESHOLD HUGE_PAGE_SIZE
+
+typedef enum {
+    ALLOCATION_HEAP,
+    ALLOCATION_MAPPED,
+    ALLOCATION_ARENA
+} allocation_kind_t;
+
+// Every allocation is preceded by header padded to MATRIX_ALIGNMENT, so data stays aligned
+typedef struct {
+    void *start;    // start of heap block or mapping
+    size_t size;    // size of mapping
+    allocation_kind_t kind;
+} allocation_header_t;
+
+struct matrix_arena {
+    char *data;
+    size_t size;
+    size_t used;
+    int overflow_reported;
+};
+
+typedef enum {
+    HUGE_PAGES_OFF,
+    HUGE_PAGES_TRANSPARENT,
+    HUGE_PAGES_EXPLICIT
+} huge_pages_t;
+
+static __thread matrix_arena_t *current_arena = NULL;
+
+static huge_pages_t huge_pages_mode(void) {
+    static int mode = -1;
+    if (mode < 0) {
+        const char *env = getenv(MATRIX_HUGE_PAGES_ENV);
+        if (!env || strcmp(env, "transparent") == 0) mode = HUGE_PAGES_TRANSPARENT;
+        else if (strcmp(env, "explicit") == 0) mode = HUGE_PAGES_EXPLICIT;
+        else mode = HUGE_PAGES_OFF;
+    }
+    return mode;
+}
+
+static size_t round_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Touches every page in parallel, so pages are faulted here and not inside timed region,
+// and (with static schedule) land on NUMA node of thread which processes that part later
+static void prefault(char *data, size_t size) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    #pragma omp parallel for schedule(static)
+    for (size_t offset = 0; offset < size; offset += page_size)
+        data[offset] = 0;
+}
+
+// Maps size bytes aligned to huge page, so transparent huge pages could back all of it
+static void *map_pages(size_t size) {
+    static int explicit_reported = 0;
+    if (huge_pages_mode() == HUGE_PAGES_EXPLICIT) {
+        void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) return data;
+        if (!explicit_reported) fprintf(stderr, "Could not map explicit huge pages, using transparent ones\n");
+        explicit_reported = 1;
+    }
+
+    char *mapping = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) return NULL;
+    char *data = (char *) round_up((size_t) mapping, HUGE_PAGE_SIZE);
+    if (data > mapping) munmap(mapping, data - mapping);
+    munmap(data + size, mapping + HUGE_PAGE_SIZE - data);
+    if (huge_pages_mode() != HUGE_PAGES_OFF)
+        madvise(data, size, MADV_HUGEPAGE);
+    return data;
+}
+
+static void zero(char *data, size_t size) {
+    if (size < MAP_THRESHOLD) {
+        memset(data, 0, size);
+        return;
+    }
+    size_t chunk = round_up(size / omp_get_max_threads() + 1, MATRIX_ALIGNMENT);
+    #pragma omp parallel for schedule(static)
+    for (size_t offset = 0; offset < size; offset += chunk)
+        memset(data + offset, 0, MIN(chunk, size - offset));
+}
+
+static void *from_arena(matrix_arena_t *arena, size_t size) {
+    size_t total = MATRIX_ALIGNMENT + round_up(size, MATRIX_ALIGNMENT);
+    if (arena->used + total > arena->size) {
+        if (!arena->overflow_reported) fprintf(stderr, "Arena of %zu bytes is full, allocating from heap\n", arena->size);
+        arena->overflow_reported = 1;
+        return NULL;
+    }
+    char *start = arena->data + arena->used;
+    arena->used += total;
+    *(allocation_header_t *) start = (allocation_header_t) { .start = start, .kind = ALLOCATION_ARENA };
+    zero(start + MATRIX_ALIGNMENT, size);
+    return start + MATRIX_ALIGNMENT;
+}
+
+void *matrix_alloc_data(size_t size) {
+    if (current_arena) {
+        void *data = from_arena(current_arena, size);
+        if (data) return data;
+    }
+
+    allocation_header_t header;
+    char *start;
+    if (size < MAP_THRESHOLD) {
+        header.kind = ALLOCATION_HEAP;
+        header.size = MATRIX_ALIGNMENT + round_up(size, MATRIX_ALIGNMENT);
+        start = aligned_alloc(MATRIX_ALIGNMENT, header.size);
+        assert(start && "could not allocate matrix");
+        memset(start + MATRIX_ALIGNMENT, 0, size);
+    } else {
+        // Note: anonymous mapping is already zeroed
+        header.kind = ALLOCATION_MAPPED;
+        header.size = round_up(MATRIX_ALIGNMENT + size, HUGE_PAGE_SIZE);
+        start = map_pages(header.size);
+        assert(start && "could not allocate matrix");
+        prefault(start, header.size);
+    }
+    header.start = start;
+    *(allocation_header_t *) start = header;
+    return start + MATRIX_ALIGNMENT;
+}
+
+void matrix_free_data(void *data) {
+    if (!data) return;
+    allocation_header_t *header = (allocation_header_t *) ((char *) data - MATRIX_ALIGNMENT);
+    switch (header->kind) {
+    case ALLOCATION_HEAP:
+        free(header->start);
+        break;
+    case ALLOCATION_MAPPED:
+        munmap(header->start, header->size);
+        break;
+    case ALLOCATION_ARENA:
+        // Note: memory of arena is released only by matrix_arena_reset
+        break;
+    }
+}
+
+matrix_arena_t *matrix_arena_create(size_t size) {
+    matrix_arena_t *arena = malloc(sizeof(matrix_arena_t));
+    arena->size = round_up(MAX(size, 1), HUGE_PAGE_SIZE);
+    arena->data = map_pages(arena->size);
+    assert(arena->data && "could not allocate arena");
+    arena->used = 0;
+    arena->overflow_reported = 0;
+    prefault(arena->data, arena->size);
+    return arena;
+}
+
+void matrix_arena_destroy(matrix_arena_t *arena) {
+    if (current_arena == arena) current_arena = NULL;
+    munmap(arena->data, arena->size);
+    free(arena);
+}
+
+void matrix_arena_reset(matrix_arena_t *arena) {
+    arena->used = 0;
+}
+
+matrix_arena_t *matrix_arena_use(matrix_arena_t *arena) {
+    matrix_arena_t *previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
@@ -0,0 +1,38 @@
+#include "matrix.h"
+#include <omp.h>
+
+static int compare_doubles(const void *a, const void *b) {
+    double diff = *(const double *) a - *(const double *) b;
+    return (diff > 0) - (diff < 0);
+}
+
+matrix_bench_stats_t matrix_bench(
+    void (*run)(void *arg), void (*reset)(void *arg), void *arg, int warmup, int repetitions, double flops
+) {
+    assert(warmup >= 0 && repetitions > 0);
+    for (int i = 0; i < warmup; i++) {
+        if (reset) reset(arg);
+        run(arg);
+    }
+
+    double *times = malloc(sizeof(double) * repetitions);
+    for (int i = 0; i < repetitions; i++) {
+        if (reset) reset(arg);
+        double start = omp_get_wtime();
+        run(arg);
+        times[i] = omp_get_wtime() - start;
+    }
+
+    matrix_bench_stats_t stats = { 0 };
+    qsort(times, repetitions, sizeof(double), compare_doubles);
+    stats.min = times[0];
+    stats.median = repetitions % 2 ? times[repetitions / 2] : (times[repetitions / 2 - 1] + times[repetitions / 2]) / 2;
+    for (int i = 0; i < repetitions; i++)
+        stats.mean += times[i] / repetitions;
+    for (int i = 0; i < repetitions; i++)
+        stats.stddev += (times[i] - stats.mean) * (times[i] - stats.mean) / repetitions;
+    stats.stddev = sqrt(stats.stddev);
+    stats.gflops = stats.median > 0 ? flops / stats.median / 1e9 : 0;
+    free(times);
+    return stats;
+}
@@ -0,0 +1,214 @@
+#include "matrix.h"
+#include "kernel.h"
+#include "pool.h"
+#include "trace.h"
+
+// Columns of B multiplied at once: their packed copy is the only temporary, it replaces
+// whole n x n output and lets result overwrite B
+#define PANEL_COLS 1024
+
+// alpha * op(A), where op(A) is A or its transpose. Triangular A has zeroes outside
+// of its stored triangle, and ones on diagonal if it has unit diagonal
+typedef struct {
+    double_matrix_t a;
+    int triangular;
+    int lower;
+    int transposed;
+    int unit_diagonal;
+    double alpha;
+} op_a_t;
+
+// Note: op(A) is upper triangular when A is upper and not transposed, or lower and transposed
+static inline int op_upper(op_a_t op) {
+    return op.triangular && op.lower == op.transposed;
+}
+
+static inline int op_lower(op_a_t op) {
+    return op.triangular && op.lower != op.transposed;
+}
+
+// Packs mc x kc block of alpha * op(A) at (i0, k0) as matrix_kernel_pack_a does.
+// Triangular op(A) is packed by columns of slivers: stored part of column is copied
+// with strides of A like in matrix_kernel_pack_a_upper_triangular_cols, the rest is zeroed
+static void pack_op_a(const matrix_kernel_t *kernel, op_a_t op, int i0, int k0, int mc, int kc, double *buf) {
+    int mr = kernel->mr;
+    const double *plain = (const double *) op.a.data;
+    int rs = 0, cs = 0;
+    if (op.a.type == NORMAL)
+        matrix_normal_strides(op.a, &rs, &cs);
+    if (!op.triangular) {
+        if (op.transposed)
+            matrix_kernel_pack_a(kernel, mc, kc, plain + matrix_normal_offset(op.a, k0, i0), cs, rs, buf);
+        else
+            matrix_kernel_pack_a(kernel, mc, kc, plain + matrix_normal_offset(op.a, i0, k0), rs, cs, buf);
+        if (op.alpha != 1)
+            for (size_t i = 0; i < matrix_kernel_packed_a_size(kernel, mc, kc); i++) buf[i] *= op.alpha;
+        return;
+    }
+
+    // Note: element (i, k) of op(A) is plain[i * i_stride + k * k_stride] for NORMAL A
+    int i_stride = op.transposed ? cs : rs, k_stride = op.transposed ? rs : cs;
+    for (int ir = 0; ir < mc; ir += mr, buf += (size_t) mr * kc) {
+        int rows = MIN(mr, mc - ir);
+        int row0 = i0 + ir;
+        if (op.a.type == UPPER_TRIANGULAR_COLS && op.transposed) {
+            // Note: row of op(A) is contiguous column of A, so sliver is copied by rows
+            memset(buf, 0, sizeof(double) * mr * kc);
+            for (int i = 0; i < rows; i++) {
+                const double *a_col = plain + (size_t) (row0 + i) * (row0 + i + 1) / 2 + k0;
+                for (int k = 0; k < MIN(kc, row0 + i - k0 + 1); k++)
+                    buf[k * mr + i] = op.alpha * a_col[k];
+            }
+        } else {
+            for (int k = 0; k < kc; k++) {
+                int col = k0 + k;
+                // Note: stored part of column of sliver is its rows [start, end)
+                int start = op_lower(op) ? MIN(rows, MAX(0, col - row0)) : 0;
+                int end = op_upper(op) ? MIN(rows, MAX(0, col - row0 + 1)) : rows;
+                double *dst = buf + k * mr;
+                int i = 0;
+                for (; i < start; i++) dst[i] = 0;
+                if (op.a.type == NORMAL) {
+                    const double *src = plain + (size_t) col * k_stride;
+                    for (; i < end; i++) dst[i] = op.alpha * src[(size_t) (row0 + i) * i_stride];
+                } else {
+                    const double *src = plain + (size_t) col * (col + 1) / 2 + row0;
+                    for (; i < end; i++) dst[i] = op.alpha * src[i];
+                }
+                for (; i < mr; i++) dst[i] = 0;
+            }
+        }
+        if (op.unit_diagonal)
+            for (int i = 0; i < rows; i++) {
+                int k = row0 + i - k0;
+                if (k >= 0 && k < kc) buf[k * mr + i] = op.alpha;
+            }
+    }
+}
+
+// One column panel of out, which is computed by tasks of pool
+typedef struct {
+    const matrix_kernel_t *kernel;
+    op_a_t op;
+    double_matrix_t b;
+    double beta;
+    double_matrix_t out;
+    int block_max_size;
+    int j0;
+    int nc;
+    int k_blocks;
+    size_t b_block_size;
+    double *b_packed;
+} panel_job_t;
+
+// Packs block row k_block of the panel of b
+static void pack_b_task(void *arg, int k_block) {
+    panel_job_t *job = arg;
+    int b_rs, b_cs;
+    matrix_normal_strides(job->b, &b_rs, &b_cs);
+    int k0 = k_block * job->block_max_size;
+    matrix_kernel_pack_b(
+        job->kernel, MIN(job->block_max_size, job->b.nrows - k0), job->nc,
+        (const double *) job->b.data + matrix_normal_offset(job->b, k0, job->j0), b_rs, b_cs,
+        job->b_packed + k_block * job->b_block_size
+    );
+}
+
+// Computes block row i_block of the panel of out
+static void tile_row_task(void *arg, int i_block) {
+    panel_job_t *job = arg;
+    MATRIX_TRACE_BEGIN(span, "tile_row");
+    const matrix_kernel_t *kernel = job->kernel;
+    op_a_t op = job->op;
+    int block_max_size = job->block_max_size, nc = job->nc, nk = job->b.nrows;
+    int out_rs, out_cs;
+    matrix_normal_strides(job->out, &out_rs, &out_cs);
+    int i0 = i_block * block_max_size;
+    int mc = MIN(block_max_size, job->out.nrows - i0);
+    double *c = (double *) job->out.data + (size_t) i0 * out_rs + job->j0;
+    // Note: beta == 0 overwrites out, so NaN in it is not propagated
+    for (int i = 0; i < mc; i++)
+        for (int j = 0; j < nc; j++)
+            c[(size_t) i * out_rs + j] = job->beta == 0 ? 0 : job->beta * c[(size_t) i * out_rs + j];
+
+    double *a_packed = matrix_kernel_scratch(MATRIX_KERNEL_SCRATCH_A, matrix_kernel_packed_a_size(kernel, block_max_size, block_max_size));
+    int k_start = op_upper(op) ? i_block : 0;
+    int k_end = op_lower(op) ? MIN(job->k_blocks, i_block + 1) : job->k_blocks;
+    for (int k_block = k_start; k_block < k_end; k_block++) {
+        int k0 = k_block * block_max_size;
+        int kc = MIN(block_max_size, nk - k0);
+        pack_op_a(kernel, op, i0, k0, mc, kc, a_packed);
+        matrix_kernel_macro(
+            kernel, mc, nc, kc, a_packed, job->b_packed + k_block * job->b_block_size, c, out_rs,
+            op_upper(op) ? i0 - k0 : MATRIX_KERNEL_DENSE
+        );
+    }
+    MATRIX_TRACE_END(span);
+}
+
+// out := beta * out + op(A) * b panel by panel. Every panel of b is packed before
+// out is written, so out might be b itself. Block rows of out are computed on pool,
+// blocks of zero triangle of op(A) are skipped. b might be any view, rows of out are contiguous
+static void multiply(op_a_t op, double_matrix_t b, double beta, double_matrix_t out, int block_max_size) {
+    int out_rs, out_cs;
+    matrix_normal_strides(out, &out_rs, &out_cs);
+    assert(out_cs == 1);
+    const matrix_kernel_t *kernel = matrix_kernel_select();
+    int i_blocks = (out.nrows + block_max_size - 1) / block_max_size;
+    int panel_cols = MIN(out.ncols, PANEL_COLS);
+    panel_job_t job = {
+        .kernel = kernel,
+        .op = op,
+        .b = b,
+        .beta = beta,
+        .out = out,
+        .block_max_size = block_max_size,
+        .k_blocks = (b.nrows + block_max_size - 1) / block_max_size,
+        .b_block_size = matrix_kernel_packed_b_size(kernel, block_max_size, panel_cols)
+    };
+    // Note: shared by all workers, only calling thread writes its scratch
+    job.b_packed = matrix_kernel_scratch(MATRIX_KERNEL_SCRATCH_B, job.b_block_size * job.k_blocks);
+
+    for (job.j0 = 0; job.j0 < out.ncols; job.j0 += panel_cols) {
+        job.nc = MIN(panel_cols, out.ncols - job.j0);
+        matrix_pool_run(job.k_blocks, NULL, pack_b_task, &job);
+        // Note: rows of zero triangle have less work, workers even it out by stealing
+        matrix_pool_run(i_blocks, NULL, tile_row_task, &job);
+    }
+}
+
+void matrix_trmm(int lower, int transposed, int unit_diagonal, double alpha, double_matrix_t a, double_matrix_t b, int block_max_size) {
+    assert(a.type == NORMAL || (a.type == UPPER_TRIANGULAR_COLS && !lower));
+    assert(b.type == NORMAL && !b.minfo.normal_info.column_major && "b is overwritten by rows");
+    assert(a.nrows == a.ncols && a.ncols == b.nrows);
+    assert(block_max_size > 0);
+    op_a_t op = {
+        .a = a,
+        .triangular = 1,
+        .lower = lower,
+        .transposed = transposed,
+        .unit_diagonal = unit_diagonal,
+        .alpha = alpha
+    };
+    multiply(op, b, 0, b, block_max_size);
+}
+
+void matrix_gemm(double alpha, double_matrix_t a, double_matrix_t b, double beta, double_matrix_t c, int block_max_size) {
+    assert(a.type == NORMAL || a.type == UPPER_TRIANGULAR_COLS);
+    assert(b.type == NORMAL && c.type == NORMAL);
+    assert(a.nrows == c.nrows && a.ncols == b.nrows && b.ncols == c.ncols);
+    assert(c.data != b.data && "use matrix_trmm to multiply in place");
+    assert(block_max_size > 0);
+    // Note: column-major c is computed as c^T := alpha * b^T * a^T + beta * c^T on transposed views
+    if (c.minfo.normal_info.column_major) {
+        assert(a.type == NORMAL && "column-major c needs NORMAL a");
+        matrix_gemm(alpha, matrix_transposed_view(b), matrix_transposed_view(a), beta, matrix_transposed_view(c), block_max_size);
+        return;
+    }
+    op_a_t op = {
+        .a = a,
+        .triangular = a.type == UPPER_TRIANGULAR_COLS,
+        .alpha = alpha
+    };
+    multiply(op, b, beta, c, block_max_size);
+}
@@ -0,0 +1,194 @@
+#include "matrix.h"
+#include "trace.h"
+#include <omp.h>
+
+// Tile size used when none of matrices is blocked
+#define CONVERT_TILE_SIZE 64
+
+#define MATRIX_TYPES \
+    X(NORMAL) \
+    X(UPPER_TRIANGULAR_COLS) \
+    X(NORMAL_BLOCKED) \
+    X(UPPER_TRIANGULAR_BLOCKED) \
+    X(SPARSE_BLOCKED)
+
+#define MATRIX_TYPES_COUNT 5
+
+// Returns pointer to element (i, j) and stride between (i, j) and (i + 1, j).
+// Note: for blocked matrices pointer is valid only until the end of block,
+// so tiles are always aligned with blocks
+static inline __attribute__((always_inline)) double *column_pointer(
+    double_matrix_t matrix, matrix_type_t type, int i, int j, int *stride
+) {
+    double *plain = (double *) matrix.data;
+    switch (type) {
+    case NORMAL: {
+        int col_stride;
+        matrix_normal_strides(matrix, stride, &col_stride);
+        return plain + matrix_normal_offset(matrix, i, j);
+    }
+    case UPPER_TRIANGULAR_COLS:
+        *stride = 1;
+        return plain + (size_t) j * (j + 1) / 2 + i;
+    case NORMAL_BLOCKED:
+    case UPPER_TRIANGULAR_BLOCKED:
+    case SPARSE_BLOCKED: {
+        int block_size = matrix.minfo.blocked_info.block_size;
+        double *block = (double *) matrix_blocked_subblock(matrix, i, j).data;
+        *stride = block_size;
+        return block + (i % block_size) * block_size + j % block_size;
+    }
+    default:
+        assert(0 && "unsupported");
+        return NULL;
+    }
+}
+
+static inline __attribute__((always_inline)) int is_triangular(matrix_type_t type) {
+    return type == UPPER_TRIANGULAR_COLS || type == UPPER_TRIANGULAR_BLOCKED;
+}
+
+static inline __attribute__((always_inline)) int block_size_of(double_matrix_t matrix, matrix_type_t type) {
+    if (type == NORMAL_BLOCKED || type == UPPER_TRIANGULAR_BLOCKED || type == SPARSE_BLOCKED)
+        return matrix.minfo.blocked_info.block_size;
+    return 0;
+}
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Copies m to out tile by tile. Types are passed separately, so after inlining
+// in every converter compiler knows them and removes all switches from inner loop
+static inline __attribute__((always_inline)) void convert_tiled(
+    double_matrix_t m, matrix_type_t m_type, double_matrix_t out, matrix_type_t out_type
+) {
+    int tile_size = CONVERT_TILE_SIZE;
+    int m_block_size = block_size_of(m, m_type);
+    int out_block_size = block_size_of(out, out_type);
+    if (m_block_size && out_block_size)
+        tile_size = gcd(m_block_size, out_block_size);
+    else if (m_block_size || out_block_size)
+        tile_size = m_block_size ? m_block_size : out_block_size;
+
+    int triangular = is_triangular(m_type) || is_triangular(out_type);
+    // Note: rows are contiguous in all types but UPPER_TRIANGULAR_COLS and column-major views
+    int rows_contiguous = m_type != UPPER_TRIANGULAR_COLS && out_type != UPPER_TRIANGULAR_COLS
+        && !(m_type == NORMAL && m.minfo.normal_info.column_major)
+        && !(out_type == NORMAL && out.minfo.normal_info.column_major);
+    int tiles_in_col = (out.nrows + tile_size - 1) / tile_size;
+    int tiles_in_row = (out.ncols + tile_size - 1) / tile_size;
+
+    #pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int tile_i = 0; tile_i < tiles_in_col; tile_i++) {
+        for (int tile_j = 0; tile_j < tiles_in_row; tile_j++) {
+            int block_start_i = tile_i * tile_size;
+            int block_start_j = tile_j * tile_size;
+            int block_end_j = MIN(out.ncols, block_start_j + tile_size);
+            // Note: tiles under diagonal of triangular matrices are zeroed
+            // (or not stored at all for UPPER_TRIANGULAR_BLOCKED)
+            if (triangular && block_start_i >= block_end_j) continue;
+            int block_end_i = MIN(out.nrows, block_start_i + tile_size);
+            // Note: elements of m in blocks, which are not stored in sparse out, are dropped,
+            // and tiles of blocks, which are not stored in sparse m, are zeroed
+            if (out_type == SPARSE_BLOCKED
+                && matrix_sparse_entry(out, block_start_i / out_block_size, block_start_j / out_block_size) < 0)
+                continue;
+            int zero = m_type == SPARSE_BLOCKED
+                && matrix_sparse_entry(m, block_start_i / m_block_size, block_start_j / m_block_size) < 0;
+
+            if (rows_contiguous) {
+                for (int i = block_start_i; i < block_end_i; i++) {
+                    int start_j = triangular ? MAX(block_start_j, i) : block_start_j;
+                    if (start_j >= block_end_j) break;
+                    int m_stride, out_stride;
+                    double *dst = column_pointer(out, out_type, i, start_j, &out_stride);
+                    if (zero)
+                        memset(dst, 0, sizeof(double) * (block_end_j - start_j));
+                    else
+                        memcpy(dst, column_pointer(m, m_type, i, start_j, &m_stride), sizeof(double) * (block_end_j - start_j));
+                }
+                continue;
+            }
+
+            for (int j = block_start_j; j < block_end_j; j++) {
+                int rows = triangular ? MIN(block_end_i, j + 1) - block_start_i : block_end_i - block_start_i;
+                if (rows <= 0) continue;
+                int m_stride, out_stride;
+                double *dst = column_pointer(out, out_type, block_start_i, j, &out_stride);
+                if (zero) {
+                    for (int i = 0; i < rows; i++)
+                        dst[i * out_stride] = 0;
+                    continue;
+                }
+                const double *src = column_pointer(m, m_type, block_start_i, j, &m_stride);
+                if (m_stride == 1 && out_stride == 1) {
+                    memcpy(dst, src, sizeof(double) * rows);
+                } else {
+                    for (int i = 0; i < rows; i++)
+                        dst[i * out_stride] = src[i * m_stride];
+                }
+            }
+        }
+    }
+}
+
+#define CONVERTER_NAME(FROM, TO) matrix_convert_##FROM##_to_##TO
+
+#define CONVERTER(FROM, TO) \
+    static void CONVERTER_NAME(FROM, TO)(double_matrix_t m, double_matrix_t out) { \
+        convert_tiled(m, FROM, out, TO); \
+    }
+
+#define X(TO) \
+    CONVERTER(NORMAL, TO) \
+    CONVERTER(UPPER_TRIANGULAR_COLS, TO) \
+    CONVERTER(NORMAL_BLOCKED, TO) \
+    CONVERTER(UPPER_TRIANGULAR_BLOCKED, TO) \
+    CONVERTER(SPARSE_BLOCKED, TO)
+MATRIX_TYPES
+#undef X
+
+typedef void (*converter_t)(double_matrix_t m, double_matrix_t out);
+
+// converters[from][to]
+static const converter_t converters[MATRIX_TYPES_COUNT][MATRIX_TYPES_COUNT] = {
+    [NORMAL] = {
+#define X(TO) CONVERTER_NAME(NORMAL, TO),
+        MATRIX_TYPES
+#undef X
+    },
+    [UPPER_TRIANGULAR_COLS] = {
+#define X(TO) CONVERTER_NAME(UPPER_TRIANGULAR_COLS, TO),
+        MATRIX_TYPES
+#undef X
+    },
+    [NORMAL_BLOCKED] = {
+#define X(TO) CONVERTER_NAME(NORMAL_BLOCKED, TO),
+        MATRIX_TYPES
+#undef X
+    },
+    [UPPER_TRIANGULAR_BLOCKED] = {
+#define X(TO) CONVERTER_NAME(UPPER_TRIANGULAR_BLOCKED, TO),
+        MATRIX_TYPES
+#undef X
+    },
+    [SPARSE_BLOCKED] = {
+#define X(TO) CONVERTER_NAME(SPARSE_BLOCKED, TO),
+        MATRIX_TYPES
+#undef X
+    },
+};
+
+void matrix_convert(double_matrix_t m, double_matrix_t out) {
+    assert(m.nrows == out.nrows && m.ncols == out.ncols);
+    assert(m.type < MATRIX_TYPES_COUNT && out.type < MATRIX_TYPES_COUNT);
+    MATRIX_TRACE_BEGIN(span, "convert");
+    converters[m.type][out.type](m, out);
+    MATRIX_TRACE_END(span);
+}
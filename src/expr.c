@@ -0,0 +1,283 @@
+#include "matrix.h"
+
+struct matrix_expr {
+    int refs;
+    int nrows;
+    int ncols;
+    // Note: leaves have matrix and no operands, products have both operands
+    double_matrix_t matrix;
+    matrix_expr_t *left;
+    matrix_expr_t *right;
+};
+
+// Node of expression being evaluated, found by pointer. Leaves and products referenced more
+// than once are factors of chains, their matrices are computed once and kept until their last use
+typedef struct {
+    const matrix_expr_t *node;
+    int uses;      // references of products of expression, 1 for its root
+    int remaining; // uses not multiplied yet
+    int planned;   // upper is known, product is planned and its cost is counted
+    int upper;
+    int evaluated;
+    int owned;     // matrix was allocated by evaluation (converted leaf or product)
+    double_matrix_t matrix;
+} shared_t;
+
+typedef struct {
+    shared_t *nodes;
+    int count;
+    int capacity;
+} memo_t;
+
+// Factor of flattened chain, blocked with block size of evaluation
+typedef struct {
+    shared_t *shared;
+} factor_t;
+
+// Optimal association of factors [i, j] of chain, stored at [i * count + j]
+typedef struct {
+    double cost;
+    int split;
+    int upper;
+} plan_t;
+
+static matrix_expr_t *expr_allocate(int nrows, int ncols) {
+    matrix_expr_t *expr = calloc(1, sizeof(matrix_expr_t));
+    expr->refs = 1;
+    expr->nrows = nrows;
+    expr->ncols = ncols;
+    return expr;
+}
+
+matrix_expr_t *matrix_expr_leaf(double_matrix_t m) {
+    matrix_expr_t *expr = expr_allocate(m.nrows, m.ncols);
+    expr->matrix = m;
+    return expr;
+}
+
+matrix_expr_t *matrix_expr_mult(matrix_expr_t *left, matrix_expr_t *right) {
+    assert(left->ncols == right->nrows);
+    matrix_expr_t *expr = expr_allocate(left->nrows, right->ncols);
+    expr->left = left;
+    expr->right = right;
+    left->refs++;
+    right->refs++;
+    return expr;
+}
+
+void matrix_expr_free(matrix_expr_t *expr) {
+    if (!expr || --expr->refs > 0) return;
+    matrix_expr_free(expr->left);
+    matrix_expr_free(expr->right);
+    free(expr);
+}
+
+static int is_upper(matrix_type_t type) {
+    return type == UPPER_TRIANGULAR_COLS || type == UPPER_TRIANGULAR_BLOCKED;
+}
+
+static shared_t *memo_find(const memo_t *memo, const matrix_expr_t *node) {
+    for (int i = 0; i < memo->count; i++)
+        if (memo->nodes[i].node == node) return &memo->nodes[i];
+    return NULL;
+}
+
+// Counts references of every node, children of shared products are counted once,
+// as they are evaluated once
+static void count_uses(memo_t *memo, const matrix_expr_t *node) {
+    shared_t *shared = memo_find(memo, node);
+    if (shared) {
+        shared->uses++;
+        shared->remaining++;
+        return;
+    }
+    if (memo->count == memo->capacity) {
+        memo->capacity = memo->capacity ? 2 * memo->capacity : 16;
+        memo->nodes = realloc(memo->nodes, sizeof(shared_t) * memo->capacity);
+    }
+    memo->nodes[memo->count++] = (shared_t) { .node = node, .uses = 1, .remaining = 1 };
+    if (node->left) {
+        count_uses(memo, node->left);
+        count_uses(memo, node->right);
+    }
+}
+
+// Product is associative, so products used once are flattened into chain of their parent
+static void flatten(const memo_t *memo, const matrix_expr_t *node, factor_t *factors, int *count) {
+    shared_t *shared = memo_find(memo, node);
+    if (node->left && shared->uses == 1) {
+        flatten(memo, node->left, factors, count);
+        flatten(memo, node->right, factors, count);
+    } else {
+        factors[(*count)++] = (factor_t) { .shared = shared };
+    }
+}
+
+// Chain of factors of node: the node itself if it is leaf, otherwise factors of its operands
+static factor_t *chain_factors(const memo_t *memo, const matrix_expr_t *node, int *count) {
+    // Note: every factor is one use of a node, and nodes have at most two operands
+    factor_t *factors = malloc(sizeof(factor_t) * (2 * memo->count + 1));
+    *count = 0;
+    if (node->left) {
+        flatten(memo, node->left, factors, count);
+        flatten(memo, node->right, factors, count);
+    } else {
+        factors[(*count)++] = (factor_t) { .shared = memo_find(memo, node) };
+    }
+    return factors;
+}
+
+// Number of multiplied pairs of blocks, as blocked kernels skip zero blocks of triangular operands.
+// Note: upper triangular operands are square, leaves by their types and products as products of them
+static double pairs_cost(int rows, int inner, int cols, int left_upper, int right_upper) {
+    assert(!left_upper || rows == inner);
+    assert(!right_upper || inner == cols);
+    double p = rows, q = inner, r = cols;
+    if (left_upper && right_upper)
+        return p * (p + 1) * (p + 2) / 6;
+    if (left_upper)
+        return q * (q + 1) / 2 * r;
+    if (right_upper)
+        return p * q * (q + 1) / 2;
+    return p * q * r;
+}
+
+// Classic matrix chain dynamic programming over O(count^2) subchains,
+// subchain is upper triangular if all of its factors are
+static plan_t *plan_chain(const factor_t *factors, int count, int block_size) {
+    plan_t *plans = malloc(sizeof(plan_t) * count * count);
+    int *blocks = malloc(sizeof(int) * (count + 1));
+    blocks[0] = matrix_blocks(factors[0].shared->node->nrows, block_size);
+    for (int i = 0; i < count; i++) {
+        blocks[i + 1] = matrix_blocks(factors[i].shared->node->ncols, block_size);
+        plans[i * count + i] = (plan_t) { .cost = 0, .split = i, .upper = factors[i].shared->upper };
+    }
+
+    for (int length = 2; length <= count; length++) {
+        for (int i = 0; i + length <= count; i++) {
+            int j = i + length - 1;
+            plan_t *plan = &plans[i * count + j];
+            plan->cost = INFINITY;
+            for (int split = i; split < j; split++) {
+                const plan_t *left = &plans[i * count + split], *right = &plans[(split + 1) * count + j];
+                double cost = left->cost + right->cost
+                    + pairs_cost(blocks[i], blocks[split + 1], blocks[j + 1], left->upper, right->upper);
+                if (cost < plan->cost) {
+                    plan->cost = cost;
+                    plan->split = split;
+                    plan->upper = left->upper && right->upper;
+                }
+            }
+        }
+    }
+    free(blocks);
+    return plans;
+}
+
+// Finds whether node is upper triangular and adds cost of its product to *cost. Shared products are
+// planned once, so their cost is counted once too
+static void plan_node(const memo_t *memo, shared_t *shared, int block_size, double *cost) {
+    if (shared->planned) return;
+    shared->planned = 1;
+    const matrix_expr_t *node = shared->node;
+    if (!node->left) {
+        shared->upper = is_upper(node->matrix.type);
+        return;
+    }
+    int count;
+    factor_t *factors = chain_factors(memo, node, &count);
+    for (int i = 0; i < count; i++)
+        plan_node(memo, factors[i].shared, block_size, cost);
+    plan_t *plans = plan_chain(factors, count, block_size);
+    shared->upper = plans[count - 1].upper;
+    *cost += plans[count - 1].cost;
+    free(plans);
+    free(factors);
+}
+
+static double_matrix_t allocate_blocked(int upper, int nrows, int ncols, int block_size) {
+    return upper
+        ? matrix_allocate_upper_triangular_blocked(nrows, block_size)
+        : matrix_allocate_blocked_rectangular(nrows, ncols, block_size);
+}
+
+// Factor is multiplied, its matrix is freed after its last use
+static void release(shared_t *shared) {
+    if (--shared->remaining == 0 && shared->owned) matrix_free(shared->matrix);
+}
+
+static double_matrix_t evaluate(const factor_t *factors, const plan_t *plans, int count, int i, int j, int block_size, int *owned) {
+    if (i == j) {
+        // Note: matrices of factors are released by their products
+        *owned = 0;
+        return factors[i].shared->matrix;
+    }
+    const plan_t *plan = &plans[i * count + j];
+    int left_owned, right_owned;
+    double_matrix_t left = evaluate(factors, plans, count, i, plan->split, block_size, &left_owned);
+    double_matrix_t right = evaluate(factors, plans, count, plan->split + 1, j, block_size, &right_owned);
+    double_matrix_t out = allocate_blocked(plan->upper, left.nrows, right.ncols, block_size);
+    matrix_omp_mult_block3(left, right, out, block_size);
+    if (left_owned) matrix_free(left);
+    else release(factors[i].shared);
+    if (right_owned) matrix_free(right);
+    else release(factors[j].shared);
+    *owned = 1;
+    return out;
+}
+
+// Computes matrix of factor once, leaves are converted unless they already have blocked layout
+// with the same block size (sparse ones are multiplied as dense)
+static void evaluate_node(const memo_t *memo, shared_t *shared, int block_size) {
+    if (shared->evaluated) return;
+    shared->evaluated = 1;
+    const matrix_expr_t *node = shared->node;
+    if (!node->left) {
+        double_matrix_t m = node->matrix;
+        matrix_type_t type = shared->upper ? UPPER_TRIANGULAR_BLOCKED : NORMAL_BLOCKED;
+        shared->matrix = m;
+        if (m.type == type && m.minfo.blocked_info.block_size == block_size) return;
+        shared->owned = 1;
+        shared->matrix = allocate_blocked(shared->upper, m.nrows, m.ncols, block_size);
+        matrix_convert(m, shared->matrix);
+        return;
+    }
+
+    int count;
+    factor_t *factors = chain_factors(memo, node, &count);
+    for (int i = 0; i < count; i++)
+        evaluate_node(memo, factors[i].shared, block_size);
+    plan_t *plans = plan_chain(factors, count, block_size);
+    shared->matrix = evaluate(factors, plans, count, 0, count - 1, block_size, &shared->owned);
+    free(plans);
+    free(factors);
+}
+
+double_matrix_t matrix_expr_eval(const matrix_expr_t *expr, int block_size) {
+    assert(block_size > 0);
+    memo_t memo = { 0 };
+    count_uses(&memo, expr);
+    shared_t *root = &memo.nodes[0];
+    double cost = 0;
+    plan_node(&memo, root, block_size, &cost);
+    evaluate_node(&memo, root, block_size);
+
+    double_matrix_t out = root->matrix;
+    if (!root->owned) {
+        // Note: single leaf which was not converted is copied, so result is always owned by caller
+        out = allocate_blocked(root->upper, out.nrows, out.ncols, block_size);
+        matrix_convert(root->matrix, out);
+    }
+    free(memo.nodes);
+    return out;
+}
+
+double matrix_expr_cost(const matrix_expr_t *expr, int block_size) {
+    assert(block_size > 0);
+    memo_t memo = { 0 };
+    count_uses(&memo, expr);
+    double cost = 0;
+    plan_node(&memo, &memo.nodes[0], block_size, &cost);
+    free(memo.nodes);
+    return 2.0 * cost * block_size * block_size * block_size;
+}
@@ -0,0 +1,355 @@
+#include "kernel.h"
+#include <immintrin.h>
+#include <pthread.h>
+
+#define SCALAR_MR 4
+#define SCALAR_NR 4
+
+#define AVX2_MR 6
+#define AVX2_NR 8
+
+#define AVX512_MR 8
+#define AVX512_NR 16
+
+// Note: single precision kernels have the same register tiles,
+// but every vector holds twice more elements
+#define SCALAR_FLOAT_NR 4
+#define AVX2_FLOAT_NR 16
+#define AVX512_FLOAT_NR 32
+
+// Adds tile computed into temporary buffer to the edge of c
+static inline void add_tile(const double *tile, int nr, double *c, int ldc, int m, int n) {
+    for (int i = 0; i < m; i++)
+        for (int j = 0; j < n; j++)
+            c[i * ldc + j] += tile[i * nr + j];
+}
+
+static void micro_scalar(int kc, const double *a, const double *b, double *c, int ldc, int m, int n) {
+    double acc[SCALAR_MR * SCALAR_NR] = { 0 };
+
+    for (int k = 0; k < kc; k++) {
+        for (int i = 0; i < SCALAR_MR; i++)
+            for (int j = 0; j < SCALAR_NR; j++)
+                acc[i * SCALAR_NR + j] += a[i] * b[j];
+        a += SCALAR_MR;
+        b += SCALAR_NR;
+    }
+
+    add_tile(acc, SCALAR_NR, c, ldc, m, n);
+}
+
+__attribute__((target("avx2,fma")))
+static void micro_avx2(int kc, const double *a, const double *b, double *c, int ldc, int m, int n) {
+    __m256d acc[AVX2_MR][2];
+    for (int i = 0; i < AVX2_MR; i++) {
+        acc[i][0] = _mm256_setzero_pd();
+        acc[i][1] = _mm256_setzero_pd();
+    }
+
+    for (int k = 0; k < kc; k++) {
+        __m256d b0 = _mm256_loadu_pd(b);
+        __m256d b1 = _mm256_loadu_pd(b + 4);
+        for (int i = 0; i < AVX2_MR; i++) {
+            __m256d ai = _mm256_broadcast_sd(a + i);
+            acc[i][0] = _mm256_fmadd_pd(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_pd(ai, b1, acc[i][1]);
+        }
+        a += AVX2_MR;
+        b += AVX2_NR;
+    }
+
+    if (m == AVX2_MR && n == AVX2_NR) {
+        for (int i = 0; i < AVX2_MR; i++) {
+            double *row = c + i * ldc;
+            _mm256_storeu_pd(row, _mm256_add_pd(_mm256_loadu_pd(row), acc[i][0]));
+            _mm256_storeu_pd(row + 4, _mm256_add_pd(_mm256_loadu_pd(row + 4), acc[i][1]));
+        }
+        return;
+    }
+
+    double tile[AVX2_MR * AVX2_NR];
+    for (int i = 0; i < AVX2_MR; i++) {
+        _mm256_storeu_pd(tile + i * AVX2_NR, acc[i][0]);
+        _mm256_storeu_pd(tile + i * AVX2_NR + 4, acc[i][1]);
+    }
+    add_tile(tile, AVX2_NR, c, ldc, m, n);
+}
+
+__attribute__((target("avx512f")))
+static void micro_avx512(int kc, const double *a, const double *b, double *c, int ldc, int m, int n) {
+    __m512d acc[AVX512_MR][2];
+    for (int i = 0; i < AVX512_MR; i++) {
+        acc[i][0] = _mm512_setzero_pd();
+        acc[i][1] = _mm512_setzero_pd();
+    }
+
+    for (int k = 0; k < kc; k++) {
+        __m512d b0 = _mm512_loadu_pd(b);
+        __m512d b1 = _mm512_loadu_pd(b + 8);
+        for (int i = 0; i < AVX512_MR; i++) {
+            __m512d ai = _mm512_set1_pd(a[i]);
+            acc[i][0] = _mm512_fmadd_pd(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_pd(ai, b1, acc[i][1]);
+        }
+        a += AVX512_MR;
+        b += AVX512_NR;
+    }
+
+    if (m == AVX512_MR && n == AVX512_NR) {
+        for (int i = 0; i < AVX512_MR; i++) {
+            double *row = c + i * ldc;
+            _mm512_storeu_pd(row, _mm512_add_pd(_mm512_loadu_pd(row), acc[i][0]));
+            _mm512_storeu_pd(row + 8, _mm512_add_pd(_mm512_loadu_pd(row + 8), acc[i][1]));
+        }
+        return;
+    }
+
+    double tile[AVX512_MR * AVX512_NR];
+    for (int i = 0; i < AVX512_MR; i++) {
+        _mm512_storeu_pd(tile + i * AVX512_NR, acc[i][0]);
+        _mm512_storeu_pd(tile + i * AVX512_NR + 8, acc[i][1]);
+    }
+    add_tile(tile, AVX512_NR, c, ldc, m, n);
+}
+
+static inline void add_tile_float(const float *tile, int nr, float *c, int ldc, int m, int n) {
+    for (int i = 0; i < m; i++)
+        for (int j = 0; j < n; j++)
+            c[i * ldc + j] += tile[i * nr + j];
+}
+
+static void micro_scalar_float(int kc, const float *a, const float *b, float *c, int ldc, int m, int n) {
+    float acc[SCALAR_MR * SCALAR_FLOAT_NR] = { 0 };
+
+    for (int k = 0; k < kc; k++) {
+        for (int i = 0; i < SCALAR_MR; i++)
+            for (int j = 0; j < SCALAR_FLOAT_NR; j++)
+                acc[i * SCALAR_FLOAT_NR + j] += a[i] * b[j];
+        a += SCALAR_MR;
+        b += SCALAR_FLOAT_NR;
+    }
+
+    add_tile_float(acc, SCALAR_FLOAT_NR, c, ldc, m, n);
+}
+
+__attribute__((target("avx2,fma")))
+static void micro_avx2_float(int kc, const float *a, const float *b, float *c, int ldc, int m, int n) {
+    __m256 acc[AVX2_MR][2];
+    for (int i = 0; i < AVX2_MR; i++) {
+        acc[i][0] = _mm256_setzero_ps();
+        acc[i][1] = _mm256_setzero_ps();
+    }
+
+    for (int k = 0; k < kc; k++) {
+        __m256 b0 = _mm256_loadu_ps(b);
+        __m256 b1 = _mm256_loadu_ps(b + 8);
+        for (int i = 0; i < AVX2_MR; i++) {
+            __m256 ai = _mm256_broadcast_ss(a + i);
+            acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += AVX2_MR;
+        b += AVX2_FLOAT_NR;
+    }
+
+    if (m == AVX2_MR && n == AVX2_FLOAT_NR) {
+        for (int i = 0; i < AVX2_MR; i++) {
+            float *row = c + i * ldc;
+            _mm256_storeu_ps(row, _mm256_add_ps(_mm256_loadu_ps(row), acc[i][0]));
+            _mm256_storeu_ps(row + 8, _mm256_add_ps(_mm256_loadu_ps(row + 8), acc[i][1]));
+        }
+        return;
+    }
+
+    float tile[AVX2_MR * AVX2_FLOAT_NR];
+    for (int i = 0; i < AVX2_MR; i++) {
+        _mm256_storeu_ps(tile + i * AVX2_FLOAT_NR, acc[i][0]);
+        _mm256_storeu_ps(tile + i * AVX2_FLOAT_NR + 8, acc[i][1]);
+    }
+    add_tile_float(tile, AVX2_FLOAT_NR, c, ldc, m, n);
+}
+
+__attribute__((target("avx512f")))
+static void micro_avx512_float(int kc, const float *a, const float *b, float *c, int ldc, int m, int n) {
+    __m512 acc[AVX512_MR][2];
+    for (int i = 0; i < AVX512_MR; i++) {
+        acc[i][0] = _mm512_setzero_ps();
+        acc[i][1] = _mm512_setzero_ps();
+    }
+
+    for (int k = 0; k < kc; k++) {
+        __m512 b0 = _mm512_loadu_ps(b);
+        __m512 b1 = _mm512_loadu_ps(b + 16);
+        for (int i = 0; i < AVX512_MR; i++) {
+            __m512 ai = _mm512_set1_ps(a[i]);
+            acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+        }
+        a += AVX512_MR;
+        b += AVX512_FLOAT_NR;
+    }
+
+    if (m == AVX512_MR && n == AVX512_FLOAT_NR) {
+        for (int i = 0; i < AVX512_MR; i++) {
+            float *row = c + i * ldc;
+            _mm512_storeu_ps(row, _mm512_add_ps(_mm512_loadu_ps(row), acc[i][0]));
+            _mm512_storeu_ps(row + 16, _mm512_add_ps(_mm512_loadu_ps(row + 16), acc[i][1]));
+        }
+        return;
+    }
+
+    float tile[AVX512_MR * AVX512_FLOAT_NR];
+    for (int i = 0; i < AVX512_MR; i++) {
+        _mm512_storeu_ps(tile + i * AVX512_FLOAT_NR, acc[i][0]);
+        _mm512_storeu_ps(tile + i * AVX512_FLOAT_NR + 16, acc[i][1]);
+    }
+    add_tile_float(tile, AVX512_FLOAT_NR, c, ldc, m, n);
+}
+
+static const matrix_kernel_t kernel_scalar = { "scalar", SCALAR_MR, SCALAR_NR, micro_scalar, 0, 0 };
+static const matrix_kernel_t kernel_avx2 = { "avx2", AVX2_MR, AVX2_NR, micro_avx2, 0, 0 };
+static const matrix_kernel_t kernel_avx512 = { "avx512", AVX512_MR, AVX512_NR, micro_avx512, 0, 0 };
+
+// Note: ordered from the widest to the narrowest
+static const matrix_kernel_t *kernels[] = { &kernel_avx512, &kernel_avx2, &kernel_scalar };
+
+// Note: indexed the same as kernels
+static const matrix_kernel_float_t float_kernels[] = {
+    { "avx512", AVX512_MR, AVX512_FLOAT_NR, micro_avx512_float, 0, 0 },
+    { "avx2", AVX2_MR, AVX2_FLOAT_NR, micro_avx2_float, 0, 0 },
+    { "scalar", SCALAR_MR, SCALAR_FLOAT_NR, micro_scalar_float, 0, 0 }
+};
+
+static int kernel_supported(const matrix_kernel_t *kernel) {
+    __builtin_cpu_init();
+    if (kernel == &kernel_avx512)
+        return __builtin_cpu_supports("avx512f");
+    if (kernel == &kernel_avx2)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return 1;
+}
+
+static const matrix_kernel_t *kernel_selected = &kernel_scalar;
+static pthread_once_t kernel_select_once = PTHREAD_ONCE_INIT;
+
+static void kernel_select_widest(void) {
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+        if (kernel_supported(kernels[i])) {
+            kernel_selected = kernels[i];
+            break;
+        }
+}
+
+const matrix_kernel_t *matrix_kernel_select(void) {
+    pthread_once(&kernel_select_once, kernel_select_widest);
+    return kernel_selected;
+}
+
+matrix_kernel_float_t matrix_kernel_float_of(const matrix_kernel_t *kernel) {
+    matrix_kernel_float_t float_kernel = float_kernels[sizeof(kernels) / sizeof(kernels[0]) - 1];
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+        if (strcmp(kernels[i]->name, kernel->name) == 0)
+            float_kernel = float_kernels[i];
+    float_kernel.kc = kernel->kc;
+    float_kernel.mc = kernel->mc;
+    return float_kernel;
+}
+
+int matrix_kernel_named(const char *name, int kc, int mc, matrix_kernel_t *kernel) {
+    assert(kc >= 0 && mc >= 0);
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (strcmp(kernels[i]->name, name) != 0) continue;
+        if (!kernel_supported(kernels[i])) return 0;
+        *kernel = *kernels[i];
+        kernel->kc = kc;
+        kernel->mc = mc;
+        return 1;
+    }
+    return 0;
+}
+
+const char *matrix_kernel_supported_name(int index) {
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+        if (kernel_supported(kernels[i]) && index-- == 0)
+            return kernels[i]->name;
+    return NULL;
+}
+
+double *matrix_kernel_alloc(size_t count) {
+    // Note: aligned_alloc requires size to be multiple of alignment
+    size_t size = (count * sizeof(double) + 63) / 64 * 64;
+    double *buf = aligned_alloc(64, size ? size : 64);
+    assert(buf && "could not allocate packing buffer");
+    return buf;
+}
+
+// Packing buffers of one thread, freed by destructor of scratch_key when the thread exits
+typedef struct {
+    double *buffers[MATRIX_KERNEL_SCRATCH_COUNT];
+    size_t counts[MATRIX_KERNEL_SCRATCH_COUNT];
+} scratch_t;
+
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_key_once = PTHREAD_ONCE_INIT;
+static __thread scratch_t *thread_scratch = NULL;
+
+static void scratch_free(void *arg) {
+    scratch_t *scratch = arg;
+    for (int slot = 0; slot < MATRIX_KERNEL_SCRATCH_COUNT; slot++)
+        free(scratch->buffers[slot]);
+    free(scratch);
+}
+
+static void scratch_key_create(void) {
+    int error = pthread_key_create(&scratch_key, scratch_free);
+    assert(!error && "could not create key of packing buffers");
+    (void) error;
+}
+
+double *matrix_kernel_scratch(int slot, size_t count) {
+    assert(slot >= 0 && slot < MATRIX_KERNEL_SCRATCH_COUNT);
+    if (!thread_scratch) {
+        pthread_once(&scratch_key_once, scratch_key_create);
+        thread_scratch = calloc(1, sizeof(scratch_t));
+        pthread_setspecific(scratch_key, thread_scratch);
+    }
+    scratch_t *scratch = thread_scratch;
+    if (scratch->counts[slot] < count) {
+        free(scratch->buffers[slot]);
+        scratch->buffers[slot] = matrix_kernel_alloc(count);
+        scratch->counts[slot] = count;
+    }
+    return scratch->buffers[slot];
+}
+
+// Splits tiles of out (numbered by rows of tiles) on nthreads contiguous ranges
+// with approximately equal FLOP count, thread t owns tiles [bounds[t], bounds[t + 1])
+void matrix_kernel_partition_upper_triangular(
+    int nrows, int ncols, int nk, int block_max_size, int nthreads, int *bounds
+) {
+    int tiles_in_row = (ncols + block_max_size - 1) / block_max_size;
+    int tiles_in_col = (nrows + block_max_size - 1) / block_max_size;
+    int tiles = tiles_in_row * tiles_in_col;
+
+    double total = 0;
+    for (int tile = 0; tile < tiles; tile++) {
+        int row = tile / tiles_in_row * block_max_size;
+        int col = tile % tiles_in_row * block_max_size;
+        total += matrix_kernel_upper_triangular_rows_cost(row, MIN(nrows, row + block_max_size), nk) * (MIN(ncols, col + block_max_size) - col);
+    }
+
+    double done = 0;
+    int thread = 1;
+    bounds[0] = 0;
+    for (int tile = 0; tile < tiles && thread < nthreads; tile++) {
+        int row = tile / tiles_in_row * block_max_size;
+        int col = tile % tiles_in_row * block_max_size;
+        double cost = matrix_kernel_upper_triangular_rows_cost(row, MIN(nrows, row + block_max_size), nk) * (MIN(ncols, col + block_max_size) - col);
+        // Note: tile goes to the thread which owns bigger part of its cost
+        while (thread < nthreads && done + cost / 2 > total * thread / nthreads)
+            bounds[thread++] = tile;
+        done += cost;
+    }
+    while (thread <= nthreads)
+        bounds[thread++] = tiles;
+}
@@ -0,0 +1,225 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "matrix.h"
+
+// Micro-kernel computes c[m x n] += a[m x kc] * b[kc x n] where
+// a is packed as kc columns of mr doubles and b as kc rows of nr doubles.
+// m <= mr and n <= nr, smaller values are used only on the edges of c
+typedef void (*matrix_micro_kernel_t)(
+    int kc, const double *a, const double *b, double *c, int ldc, int m, int n
+);
+
+typedef struct {
+    const char *name;
+    int mr;
+    int nr;
+    matrix_micro_kernel_t micro;
+    // Depth (L1) and rows (L2) of parts of packed panels multiplied at once,
+    // 0 means whole panel
+    int kc;
+    int mc;
+} matrix_kernel_t;
+
+// Same as matrix_kernel_t but for single precision
+typedef void (*matrix_micro_kernel_float_t)(
+    int kc, const float *a, const float *b, float *c, int ldc, int m, int n
+);
+
+typedef struct {
+    const char *name;
+    int mr;
+    int nr;
+    matrix_micro_kernel_float_t micro;
+    int kc;
+    int mc;
+} matrix_kernel_float_t;
+
+// Pass as diag to matrix_kernel_macro when A has no zeroed lower part
+#define MATRIX_KERNEL_DENSE (-(1 << 30))
+
+// Returns widest kernel supported by current CPU (checked once with CPUID)
+// without splitting of packed panels
+const matrix_kernel_t *matrix_kernel_select(void);
+
+// Returns single precision kernel for the same ISA and panel parts as given one
+matrix_kernel_float_t matrix_kernel_float_of(const matrix_kernel_t *kernel);
+
+// Copies kernel with given name and panel parts to *kernel, returns 0 if it is not supported by CPU
+int matrix_kernel_named(const char *name, int kc, int mc, matrix_kernel_t *kernel);
+
+// Kernel for multiplication of given types with parameters from tuning cache, or selected kernel
+// if cache has no entry for them. Defined in tuning.c, resolved kernels are memoized per key
+matrix_kernel_t matrix_tuning_kernel(matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims);
+
+// Precisions of specialized kernels: MIXED multiplies float matrices into double out
+typedef enum {
+    MATRIX_PRECISION_DOUBLE,
+    MATRIX_PRECISION_FLOAT,
+    MATRIX_PRECISION_MIXED,
+    MATRIX_PRECISIONS_COUNT
+} matrix_precision_t;
+
+// Multiplies with kernel of registry in matrix.c, returns 0 if there is no specialization
+// for such types. Data of m1 and m2 (and of out for FLOAT) is float for FLOAT and MIXED,
+// matrices are their layout descriptors (see matrix_float_layout).
+// Micro-kernel is tuned one, unless it is given explicitly (autotuner measures candidates so)
+int matrix_mult_block3_specialized(
+    matrix_precision_t precision, int parallel, double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size,
+    const matrix_kernel_t *tuned
+);
+
+// Returns name of index-th kernel supported by current CPU or NULL
+const char *matrix_kernel_supported_name(int index);
+
+// Allocates buffer of count doubles aligned for any SIMD load
+double *matrix_kernel_alloc(size_t count);
+
+enum {
+    MATRIX_KERNEL_SCRATCH_A,
+    MATRIX_KERNEL_SCRATCH_B,
+    MATRIX_KERNEL_SCRATCH_BOUNDS, // partition bounds of pool jobs
+    MATRIX_KERNEL_SCRATCH_COUNT
+};
+
+// Returns packing buffer of at least count doubles owned by calling thread.
+// Buffers are reused (and only grow) between calls, so they should not be freed,
+// all of them are freed when the thread exits
+double *matrix_kernel_scratch(int slot, size_t count);
+
+static inline float *matrix_kernel_float_scratch(int slot, size_t count) {
+    return (float *) matrix_kernel_scratch(slot, (count + 1) / 2);
+}
+
+// FLOP count of out rows [row_start, row_end) when m1 is upper triangular
+// with nk columns: row i of out needs (nk - i) multiplications per column
+static inline double matrix_kernel_upper_triangular_rows_cost(int row_start, int row_end, int nk) {
+    double rows = row_end - row_start;
+    return rows * nk - (row_start + row_end - 1) * rows / 2;
+}
+
+// Splits tiles of out (numbered by rows of tiles) on nthreads contiguous ranges
+// with approximately equal FLOP count, thread t owns tiles [bounds[t], bounds[t + 1])
+void matrix_kernel_partition_upper_triangular(
+    int nrows, int ncols, int nk, int block_max_size, int nthreads, int *bounds
+);
+
+// Note: packing and macro-kernel are defined here, so callers with compile-time
+// known sizes get them specialized. They are generated for every precision:
+// matrix_kernel_* for double, matrix_kernel_float_* for float and matrix_kernel_mixed_*
+// packers, which read float matrices into double panels
+
+#define MATRIX_KERNEL_DEFINE_PACKERS(PREFIX, KERNEL_T, SRC_T, DST_T) \
+    /* Sizes (in elements) of buffers required by pack functions */ \
+    static inline size_t PREFIX##_packed_a_size(const KERNEL_T *kernel, int mc, int kc) { \
+        return (size_t) ((mc + kernel->mr - 1) / kernel->mr) * kernel->mr * kc; \
+    } \
+    \
+    static inline size_t PREFIX##_packed_b_size(const KERNEL_T *kernel, int kc, int nc) { \
+        return (size_t) ((nc + kernel->nr - 1) / kernel->nr) * kernel->nr * kc; \
+    } \
+    \
+    /* Packs mc x kc submatrix with element (i, k) placed at a[i * rs + k * cs] */ \
+    static inline void PREFIX##_pack_a(const KERNEL_T *kernel, int mc, int kc, const SRC_T *a, int rs, int cs, DST_T *buf) { \
+        int mr = kernel->mr; \
+        for (int ir = 0; ir < mc; ir += mr) { \
+            int m = MIN(mr, mc - ir); \
+            for (int k = 0; k < kc; k++) { \
+                const SRC_T *col = a + ir * rs + k * cs; \
+                int i = 0; \
+                for (; i < m; i++) buf[i] = col[i * rs]; \
+                for (; i < mr; i++) buf[i] = 0; \
+                buf += mr; \
+            } \
+        } \
+    } \
+    \
+    /* Packs mc x kc submatrix of UPPER_TRIANGULAR_COLS data starting at (i0, k0). */ \
+    /* Column of UPPER_TRIANGULAR_COLS is contiguous, and only rows <= col are stored */ \
+    static inline void PREFIX##_pack_a_upper_triangular_cols( \
+        const KERNEL_T *kernel, const SRC_T *plain, int i0, int k0, int mc, int kc, DST_T *buf \
+    ) { \
+        int mr = kernel->mr; \
+        for (int ir = 0; ir < mc; ir += mr) { \
+            int rows = MIN(mr, mc - ir); \
+            for (int k = 0; k < kc; k++) { \
+                int col = k0 + k; \
+                const SRC_T *col_data = plain + (size_t) col * (col + 1) / 2; \
+                for (int i = 0; i < mr; i++) { \
+                    int row = i0 + ir + i; \
+                    buf[i] = (i < rows && row <= col) ? col_data[row] : 0; \
+                } \
+                buf += mr; \
+            } \
+        } \
+    } \
+    \
+    /* Packs kc x nc submatrix with element (k, j) placed at b[k * rs + j * cs] */ \
+    static inline void PREFIX##_pack_b(const KERNEL_T *kernel, int kc, int nc, const SRC_T *b, int rs, int cs, DST_T *buf) { \
+        int nr = kernel->nr; \
+        for (int jr = 0; jr < nc; jr += nr) { \
+            int n = MIN(nr, nc - jr); \
+            for (int k = 0; k < kc; k++) { \
+                const SRC_T *row = b + k * rs + jr * cs; \
+                int j = 0; \
+                if (cs == 1) \
+                    for (; j < n; j++) buf[j] = row[j]; \
+                else \
+                    for (; j < n; j++) buf[j] = row[j * cs]; \
+                for (; j < nr; j++) buf[j] = 0; \
+                buf += nr; \
+            } \
+        } \
+    }
+
+// Computes c[mc x nc] += a[mc x kc] * b[kc x nc] for packed a and b.
+// Note: diag is (i0 - k0) of the A panel when A is upper triangular,
+// all slivers of A which are zeroed in k < i + diag are skipped.
+// Packed slivers store whole kc depth, so part of sliver with k in
+// [k_start, k_end) is simply contiguous part of it
+#define MATRIX_KERNEL_DEFINE_MACRO(PREFIX, KERNEL_T, T) \
+    static inline void PREFIX##_macro( \
+        const KERNEL_T *kernel, int mc, int nc, int kc, \
+        const T *a, const T *b, T *c, int ldc, int diag \
+    ) { \
+        int mr = kernel->mr; \
+        int nr = kernel->nr; \
+        int kc_step = kernel->kc > 0 ? kernel->kc : kc; \
+        int mc_step = kernel->mc > 0 ? (kernel->mc + mr - 1) / mr * mr : mc; \
+        for (int k_start = 0; k_start < kc; k_start += kc_step) { \
+            int k_end = MIN(kc, k_start + kc_step); \
+            for (int ic = 0; ic < mc; ic += mc_step) { \
+                /* First row of sliver is the densest one, so if it has */ \
+                /* zeroes for k < skip, whole sliver has */ \
+                if (ic + diag >= k_end) break; \
+                int ic_end = MIN(mc, ic + mc_step); \
+                for (int jr = 0; jr < nc; jr += nr) { \
+                    const T *b_sliver = b + (size_t) jr * kc; \
+                    for (int ir = ic; ir < ic_end; ir += mr) { \
+                        int skip = MAX(k_start, ir + diag); \
+                        if (skip >= k_end) break; \
+                        const T *a_sliver = a + (size_t) ir * kc; \
+                        kernel->micro( \
+                            k_end - skip, \
+                            a_sliver + (size_t) skip * mr, \
+                            b_sliver + (size_t) skip * nr, \
+                            c + (size_t) ir * ldc + jr, \
+                            ldc, \
+                            MIN(mr, mc - ir), \
+                            MIN(nr, nc - jr) \
+                        ); \
+                    } \
+                } \
+            } \
+        } \
+    }
+
+MATRIX_KERNEL_DEFINE_PACKERS(matrix_kernel, matrix_kernel_t, double, double)
+MATRIX_KERNEL_DEFINE_MACRO(matrix_kernel, matrix_kernel_t, double)
+
+MATRIX_KERNEL_DEFINE_PACKERS(matrix_kernel_float, matrix_kernel_float_t, float, float)
+MATRIX_KERNEL_DEFINE_MACRO(matrix_kernel_float, matrix_kernel_float_t, float)
+
+MATRIX_KERNEL_DEFINE_PACKERS(matrix_kernel_mixed, matrix_kernel_t, float, double)
+
+#endif
@@ -1,12 +1,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "matrix.h"
+#include "matrix_float.h"
+#include "trace.h"
+#include "pool.h"
 #include <time.h>
 #include <omp.h>
 #include <getopt.h>
+#include <unistd.h>
 
 #define DEFAULT_DIM_SIZE 2880
 #define DEFAULT_BLOCK_SIZE (DEFAULT_DIM_SIZE / 16)
+#define DEFAULT_STRASSEN_CUTOFF 512
+#define DEFAULT_BATCH_SIZE 256
+#define DEFAULT_MEMORY_BUDGET_MB 256
+#define DEFAULT_BAND_BLOCKS 2
+#define DEFAULT_WARMUP 1
+#define DEFAULT_REPETITIONS 5
+#define DEFAULT_FREIVALDS_ROUNDS 8
+// Note: elements closer than this are equal in exact verification regardless of tolerance
+#define MAX_ULPS 16
+// Max number of values in each swept list of benchmark mode
+#define MAX_SWEEP 32
+
+#define TRACE_FILE_ENV "MATRIX_TRACE_FILE"
+#define DEFAULT_TRACE_FILE "matrix_trace.json"
 
 #define TIME_ME(CODE, time_var) \
     { \
@@ -16,17 +34,288 @@
         time_var = end - start; \
     }
 
-// Note: how much digits after . we use in comparison of float numbers
-#define PRECISION 1000000ll
+typedef enum {
+    PRECISION_DOUBLE,
+    PRECISION_FLOAT,
+    PRECISION_MIXED
+} precision_t;
+
+static const char *precision_names[] = {
+    [PRECISION_DOUBLE] = "double",
+    [PRECISION_FLOAT] = "float",
+    [PRECISION_MIXED] = "mixed"
+};
+
+// Note: allowed error relative to expected element, but at least to root mean square of expected
+// (exact verification) or to bound of rounding errors of row (Freivalds verification), mixed precision
+// loses only rounding of inputs to float, float also accumulates in single precision
+static const double tolerances[] = {
+    [PRECISION_DOUBLE] = 1e-10,
+    [PRECISION_FLOAT] = 1e-4,
+    [PRECISION_MIXED] = 1e-5
+};
 
-int verify(double_matrix_t expected, double_matrix_t result) {
+// Prints max absolute and relative (to max absolute value of expected) differences
+void report_accuracy(double_matrix_t expected, double_matrix_t result) {
+    double max_error = 0;
+    double max_value = 0;
+    #pragma omp parallel for reduction(max:max_error, max_value) schedule(static)
     for (int i = 0; i < result.nrows; i++)
-        for (int j = 0; j < result.ncols; j++)
-            if (((long long) matrix_get_or_zero(expected, i, j) * PRECISION) != ((long long) matrix_get_or_zero(result, i, j) * PRECISION)) {
-                printf("MATRIX NOT SAME: %.3f != %.3f\n", matrix_get_or_zero(expected, i, j), matrix_get_or_zero(result, i, j));
-                return 0;
+        for (int j = 0; j < result.ncols; j++) {
+            double value = matrix_get_or_zero(expected, i, j);
+            max_error = MAX(max_error, fabs(value - matrix_get_or_zero(result, i, j)));
+            max_value = MAX(max_value, fabs(value));
+        }
+    printf("Max absolute error: %e, max relative error: %e\n", max_error, max_value > 0 ? max_error / max_value : 0);
+}
+
+// Elements, which cancel to nearly zero, keep rounding errors of their terms, so their
+// absolute tolerance in exact verification is relative to this typical magnitude of expected
+double root_mean_square(double_matrix_t matrix) {
+    double sum = 0;
+    #pragma omp parallel for reduction(+:sum) schedule(static)
+    for (int i = 0; i < matrix.nrows; i++)
+        for (int j = 0; j < matrix.ncols; j++) {
+            double value = matrix_get_or_zero(matrix, i, j);
+            sum += value * value;
+        }
+    return sqrt(sum / ((double) matrix.nrows * matrix.ncols));
+}
+
+// Returns 0 if algorithm does not use tunable blocked multiplication
+int algorithm_types(int algorithm, matrix_type_t *m1_type, matrix_type_t *m2_type, int *parallel) {
+    switch (algorithm) {
+    case 2:
+    case 4:
+    case 7:
+        *m1_type = UPPER_TRIANGULAR_COLS;
+        *m2_type = NORMAL;
+        // Note: products of batch are multiplied serially
+        *parallel = algorithm == 4;
+        return 1;
+    case 3:
+    case 5:
+        *m1_type = UPPER_TRIANGULAR_BLOCKED;
+        *m2_type = NORMAL_BLOCKED;
+        *parallel = algorithm == 5;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Returns alpha * op(a) as NORMAL matrix, with triangle of a and diagonal selected as matrix_trmm
+// reads them, so results of algorithms 9 and 15 are verified as products of it and B
+double_matrix_t explicit_operand(double_matrix_t a, int lower, int transposed, int unit_diagonal, double alpha) {
+    double_matrix_t op = matrix_allocate(a.nrows, a.ncols);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < a.nrows; i++) {
+        for (int k = 0; k < a.ncols; k++) {
+            int row = transposed ? k : i, col = transposed ? i : k;
+            double value = (lower ? row >= col : row <= col) ? matrix_get_or_zero(a, row, col) : 0;
+            if (row == col && unit_diagonal) value = 1;
+            matrix_set(op, i, k, alpha * value);
+        }
+    }
+    return op;
+}
+
+// Runs algorithms 2-5 in single or mixed precision. Inputs are rounded to float
+// after layout conversion, result is converted back to double for verification
+double multiply_float(
+    int algorithm, precision_t precision, double_matrix_t A, double_matrix_t B,
+    double_matrix_t *result, int block_size, double *conversion_time_in_seconds
+) {
+    int blocked = algorithm == 3 || algorithm == 5;
+    int parallel = algorithm == 4 || algorithm == 5;
+    double time_in_seconds, back_conversion_time_in_seconds = 0;
+    float_matrix_t A_float, B_float, result_float;
+    double_matrix_t A_layout, B_layout;
+    TIME_ME(
+        A_layout = blocked ? matrix_convert_to_upper_triangular_blocked(A, block_size) : A;
+        B_layout = blocked ? matrix_convert_to_normal_blocked(B, block_size) : B;
+        if (blocked) {
+            double_matrix_t result_layout = matrix_convert_to_normal_blocked(*result, block_size);
+            matrix_free(*result);
+            *result = result_layout;
+        }
+        A_float = matrix_float_allocate_like(A_layout);
+        B_float = matrix_float_allocate_like(B_layout);
+        matrix_float_from_double(A_layout, A_float);
+        matrix_float_from_double(B_layout, B_float);
+        if (precision == PRECISION_FLOAT)
+            result_float = matrix_float_allocate_like(*result),
+        *conversion_time_in_seconds
+    );
+    if (blocked) {
+        matrix_free(A_layout);
+        matrix_free(B_layout);
+    }
+
+    if (precision == PRECISION_MIXED) {
+        TIME_ME(
+            if (parallel)
+                matrix_mixed_omp_mult_block3(A_float, B_float, *result, block_size);
+            else
+                matrix_mixed_mult_block3(A_float, B_float, *result, block_size),
+            time_in_seconds
+        );
+    } else {
+        TIME_ME(
+            if (parallel)
+                matrix_float_omp_mult_block3(A_float, B_float, result_float, block_size);
+            else
+                matrix_float_mult_block3(A_float, B_float, result_float, block_size),
+            time_in_seconds
+        );
+        TIME_ME(
+            matrix_float_to_double(result_float, *result),
+            back_conversion_time_in_seconds
+        );
+        matrix_float_free(result_float);
+    }
+    *conversion_time_in_seconds += back_conversion_time_in_seconds;
+
+    matrix_float_free(A_float);
+    matrix_float_free(B_float);
+    return time_in_seconds;
+}
+
+// Note: does nothing unless built with make TRACE=1
+void write_trace(void) {
+    const char *path = getenv(TRACE_FILE_ENV) ? getenv(TRACE_FILE_ENV) : DEFAULT_TRACE_FILE;
+    if (!MATRIX_TRACE_WRITE(path))
+        fprintf(stderr, "Could not write trace to %s\n", path);
+}
+
+// Parses comma separated list of positive integers, returns number of values
+int parse_list(const char *arg, int *values, int max_count) {
+    int count = 0;
+    char *end;
+    for (const char *c = arg; *c && count < max_count; c = *end ? end + 1 : end) {
+        values[count] = strtol(c, &end, 10);
+        assert(values[count] > 0 && end != c);
+        count++;
+    }
+    return count;
+}
+
+typedef struct {
+    int algorithm;
+    double_matrix_t A;
+    double_matrix_t B;
+    double_matrix_t result;
+    int block_size;
+    int strassen_cutoff;
+} bench_case_t;
+
+static void bench_run(void *arg) {
+    bench_case_t *bench = arg;
+    switch (bench->algorithm) {
+    case 1:
+        matrix_mult3(bench->A, bench->B, bench->result);
+        break;
+    case 2:
+    case 3:
+        matrix_mult_block3(bench->A, bench->B, bench->result, bench->block_size);
+        break;
+    case 4:
+    case 5:
+        matrix_omp_mult_block3(bench->A, bench->B, bench->result, bench->block_size);
+        break;
+    case 6:
+        matrix_strassen_mult3(bench->A, bench->B, bench->result, bench->strassen_cutoff);
+        break;
+    }
+}
+
+// Note: blocked multiplications accumulate into result
+static void bench_reset(void *arg) {
+    bench_case_t *bench = arg;
+    double_matrix_t result = bench->result;
+    memset(result.data, 0, sizeof(double) * matrix_storage_size(
+        result.type, result.nrows, result.ncols, result.minfo.blocked_info.block_size
+    ));
+}
+
+// Benchmark mode: inputs are generated and converted once for every dimension and block size,
+// then every configuration is run warmup times and measured repetitions times on the same buffers
+int benchmark(
+    int algorithm, int json, const int *dims, int dims_count, const int *block_sizes, int block_sizes_count,
+    const int *threads, int threads_count, int warmup, int repetitions, int strassen_cutoff, int random_seed, int pin
+) {
+    if (algorithm > 6) {
+        fprintf(stderr, "Algorithm %d could not be benchmarked\n", algorithm);
+        return -1;
+    }
+    int blocked = algorithm == 3 || algorithm == 5 || algorithm == 6;
+    int first = 1;
+    if (json)
+        printf("[\n");
+    else
+        printf("Algorithm,Threads,Dims,BlockSize,Runs,Min,Median,Mean,Stddev,GFLOPS\n");
+
+    for (int d = 0; d < dims_count; d++) {
+        double_matrix_t A = matrix_allocate_upper_triangular_cols(dims[d]);
+        double_matrix_t B = matrix_allocate(dims[d], dims[d]);
+        matrix_fill_random(A, random_seed, 0);
+        matrix_fill_random(B, random_seed, 1);
+
+        for (int b = 0; b < block_sizes_count; b++) {
+            int block_size = MIN(block_sizes[b], dims[d]);
+            bench_case_t bench = {
+                .algorithm = algorithm,
+                .block_size = block_size,
+                .strassen_cutoff = strassen_cutoff
+            };
+            if (algorithm == 1) {
+                bench.A = matrix_convert_to_normal(A);
+                bench.B = matrix_convert_to_normal(B);
+                bench.result = matrix_allocate(dims[d], dims[d]);
+            } else if (blocked) {
+                bench.A = matrix_convert_to_upper_triangular_blocked(A, block_size);
+                bench.B = matrix_convert_to_normal_blocked(B, block_size);
+                bench.result = matrix_allocate_blocked(dims[d], block_size);
+            } else {
+                bench.A = A;
+                bench.B = B;
+                bench.result = matrix_allocate(dims[d], dims[d]);
             }
-    return 1;
+            double flops = matrix_mult_flops(A, B);
+
+            for (int t = 0; t < threads_count; t++) {
+                omp_set_num_threads(threads[t]);
+                matrix_pool_init(threads[t], pin);
+                matrix_bench_stats_t stats = matrix_bench(bench_run, bench_reset, &bench, warmup, repetitions, flops);
+                if (json)
+                    printf(
+                        "%s  {\"algorithm\": %d, \"threads\": %d, \"dims\": %d, \"block_size\": %d, \"runs\": %d, "
+                        "\"min\": %.6f, \"median\": %.6f, \"mean\": %.6f, \"stddev\": %.6f, \"gflops\": %.3f}",
+                        first ? "" : ",\n", algorithm, threads[t], dims[d], block_size, repetitions,
+                        stats.min, stats.median, stats.mean, stats.stddev, stats.gflops
+                    );
+                else
+                    printf(
+                        "%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.3f\n",
+                        algorithm, threads[t], dims[d], block_size, repetitions,
+                        stats.min, stats.median, stats.mean, stats.stddev, stats.gflops
+                    );
+                fflush(stdout);
+                first = 0;
+            }
+
+            if (bench.A.data != A.data) matrix_free(bench.A);
+            if (bench.B.data != B.data) matrix_free(bench.B);
+            matrix_free(bench.result);
+        }
+
+        matrix_free(A);
+        matrix_free(B);
+    }
+
+    if (json)
+        printf("%s]\n", first ? "" : "\n");
+    return 0;
 }
 
 int print(double_matrix_t matrix) {
@@ -43,78 +332,284 @@ int print(double_matrix_t matrix) {
     "\t A * B = C\n" \
     "where:\n" \
     "\tA - upper triangular matrix\n" \
-    "\tB - square matrix\n" \
+    "\tB - square matrix, or dims x -l matrix\n" \
     "\nOptions:\n" \
     "\t-n - no verify, disable verification after run\n" \
+    "\t-v - set verification: freivalds (default, randomized O(n^2) check) or exact (parallel reference product\n" \
+    "\t     compared elementwise, reports accuracy of algorithms 6 and 14 and of single and mixed precision)\n" \
+    "\t-k - set number of rounds of freivalds verification (default 8)\n" \
     "\t-d - set matrix dimension size (default 2880)\n" \
-    "\t-b - set matrix block size (default 2880 / 16)\n" \
+    "\t-l - set number of columns of B and C (default -d, algorithms 1-5, 9, 13 and 15)\n" \
+    "\t-b - set matrix block size (default from tuning cache, otherwise 2880 / 16)\n" \
+    "\t-u - autotune block sizes and micro-kernel for chosen algorithm and dimension, save them to tuning cache\n" \
     "\t-s - set seed for random matrix fill\n" \
     "\t-t - print elapsed time (only for parallel build!)\n" \
-    "\t-a - use one of 3 algorithms\n" \
+    "\t-c - print elapsed time of matrix layout conversions (after -t time)\n" \
+    "\t-r - set recursion cutoff size for Strassen-Winograd (default 512)\n" \
+    "\t-m - set number of products in batch for algorithms 7, 10 and 14 (default 256)\n" \
+    "\t-o - set memory budget in MiB for out-of-core algorithm 8 (default 256)\n" \
+    "\t-f - set directory for matrix files of algorithm 8 (default .)\n" \
+    "\t-q - set half-bandwidth of B in blocks for sparse algorithm 11 (default 2)\n" \
+    "\t-p - set precision of algorithms 2-5: double (default), float, or mixed (float inputs, double accumulation)\n" \
+    "\t-x - benchmark mode, print csv or json statistics of -i runs after -w warm-up runs, instead of single run.\n" \
+    "\t     -d, -b and -T accept comma separated lists, every combination of them is measured (algorithms 1-6)\n" \
+    "\t-w - set number of warm-up runs in benchmark mode (default 1)\n" \
+    "\t-i - set number of measured runs in benchmark mode (default 5)\n" \
+    "\t-T - set numbers of threads in benchmark mode (default OMP_NUM_THREADS)\n" \
+    "\t-P - pin worker threads of pool used by algorithms 4 and 5 to their own cores\n" \
+    "\t-M - make B of every second pair of products in stream of algorithm 10 upper triangular\n" \
+    "\t-e - set variant of TRMM of algorithm 9 as letters: l (lower A, its upper triangle is not read),\n" \
+    "\t     t (transposed A), u (unit diagonal, diagonal of A is not read), e.g. -e ltu (default upper A)\n" \
+    "\t-g - set alpha of algorithms 9 and 15 (default 1)\n" \
+    "\t-a - use one of 15 algorithms\n" \
     "\t\t1 - simple matrix multiplication\n" \
     "\t\t2 - save A as flat array and make blocked multiplication\n" \
     "\t\t3 - save A and B as blocked matrices and make blocked multiplication\n" \
-    "\t\t4 - same as 2 but each block multiplied with OMP task on different cores\n"
+    "\t\t4 - same as 2 but tiles of C are balanced between OMP threads by FLOP count\n" \
+    "\t\t5 - same as 3 but tiles of C are balanced between OMP threads by FLOP count\n" \
+    "\t\t6 - same as 3 but with Strassen-Winograd recursion, reports accuracy against 1\n" \
+    "\t\t7 - batch of -m products like in 2 multiplied on all cores at once, prints aggregate GFLOP/s\n" \
+    "\t\t8 - same as 3 but A, B and C are mapped files multiplied out-of-core within -o memory budget\n" \
+    "\t\t9 - B := alpha * op(A) * B in place with triangular multiplication (TRMM, see -e), C is not allocated\n" \
+    "\t\t10 - stream of -m products like in 5 submitted asynchronously, layout conversions of one product\n" \
+    "\t\t     overlap multiplication of another, prints aggregate GFLOP/s\n" \
+    "\t\t11 - same as 5 but B is banded (blocks farther than -q from diagonal are zero) and stored\n" \
+    "\t\t     as SPARSE_BLOCKED, only pairs of non-zero blocks are multiplied\n" \
+    "\t\t12 - C = A * A2 * B for another upper triangular A2 with lazy expression, which picks association\n" \
+    "\t\t     order and keeps A * A2 upper triangular\n" \
+    "\t\t13 - same as 4 but B is slice of bigger column-major array and C of bigger row-major array,\n" \
+    "\t\t     both are multiplied in place through strided views without copies\n" \
+    "\t\t14 - -m products like in 6 repeated with C and temporaries taken from arena, which is reset\n" \
+    "\t\t     after every product, prints aggregate GFLOP/s\n" \
+    "\t\t15 - C := alpha * A * B with GEMM as two products over halves of inner dimension, the first one\n" \
+    "\t\t     overwrites C (beta = 0), the second one is accumulated to it (beta = 1)\n"
 
 int main(int argc, char *argv[]) {
     int dimension_size = DEFAULT_DIM_SIZE;
-    int block_size = DEFAULT_BLOCK_SIZE;
+    // Note: 0 means square B
+    int columns = 0;
+    // Note: 0 means block size from tuning cache
+    int block_size = 0;
+    int strassen_cutoff = DEFAULT_STRASSEN_CUTOFF;
+    int batch_size = DEFAULT_BATCH_SIZE;
+    size_t memory_budget = (size_t) DEFAULT_MEMORY_BUDGET_MB << 20;
+    int band_blocks = DEFAULT_BAND_BLOCKS;
+    const char *files_directory = ".";
+    int dims_list[MAX_SWEEP] = { DEFAULT_DIM_SIZE }, dims_count = 1;
+    int block_size_list[MAX_SWEEP], block_sizes_count = 0;
+    int threads_list[MAX_SWEEP] = { omp_get_max_threads() }, threads_count = 1;
+    const char *benchmark_format = NULL;
+    int warmup = DEFAULT_WARMUP;
+    int repetitions = DEFAULT_REPETITIONS;
     int random_seed = 42;
     int algorithm = 4;
+    precision_t precision = PRECISION_DOUBLE;
 
     int print_elapsed_time = 0;
+    int print_conversion_time = 0;
     int should_verify = 1;
+    int exact_verification = 0;
+    int freivalds_rounds = DEFAULT_FREIVALDS_ROUNDS;
+    int should_autotune = 0;
+    int pin_threads = 0;
+    int mix_stream_types = 0;
+    int trmm_lower = 0, trmm_transposed = 0, trmm_unit_diagonal = 0;
+    double alpha = 1;
 
     int opt;
-    while ((opt = getopt(argc, argv, "d:b:s:ta:n")) != -1) {
+    while ((opt = getopt(argc, argv, "d:l:b:r:m:o:f:q:s:p:x:w:i:T:PMe:g:tca:nv:k:u")) != -1) {
         switch (opt) {
         case 'd':
-            dimension_size = atoi(optarg);
-            assert(dimension_size > 0);
+            dims_count = parse_list(optarg, dims_list, MAX_SWEEP);
+            dimension_size = dims_list[0];
+            break;
+        case 'l':
+            columns = atoi(optarg);
+            assert(columns > 0);
             break;
         case 'b':
-            block_size = atoi(optarg);
-            assert(block_size > 0);
+            block_sizes_count = parse_list(optarg, block_size_list, MAX_SWEEP);
+            block_size = block_size_list[0];
+            break;
+        case 'x':
+            benchmark_format = optarg;
+            if (strcmp(optarg, "csv") != 0 && strcmp(optarg, "json") != 0) {
+                fprintf(stderr, HELP);
+                return -1;
+            }
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            assert(warmup >= 0);
+            break;
+        case 'i':
+            repetitions = atoi(optarg);
+            assert(repetitions > 0);
+            break;
+        case 'T':
+            threads_count = parse_list(optarg, threads_list, MAX_SWEEP);
+            break;
+        case 'r':
+            strassen_cutoff = atoi(optarg);
+            assert(strassen_cutoff > 0);
+            break;
+        case 'm':
+            batch_size = atoi(optarg);
+            assert(batch_size > 0);
+            break;
+        case 'o':
+            assert(atoi(optarg) > 0);
+            memory_budget = (size_t) atoi(optarg) << 20;
+            break;
+        case 'f':
+            files_directory = optarg;
+            break;
+        case 'q':
+            band_blocks = atoi(optarg);
+            assert(band_blocks >= 0);
             break;
         case 's':
             random_seed = atoi(optarg);
             break;
+        case 'p':
+            for (precision = PRECISION_DOUBLE; precision <= PRECISION_MIXED; precision++)
+                if (strcmp(optarg, precision_names[precision]) == 0) break;
+            if (precision > PRECISION_MIXED) {
+                fprintf(stderr, HELP);
+                return -1;
+            }
+            break;
         case 't':
             print_elapsed_time = 1;
             break;
+        case 'c':
+            print_conversion_time = 1;
+            break;
         case 'a':
             algorithm = atoi(optarg);
-            assert(algorithm >= 1 && algorithm <= 4);
+            assert(algorithm >= 1 && algorithm <= 15);
             break;
         case 'n':
             should_verify = 0;
             break;
+        case 'v':
+            if (strcmp(optarg, "freivalds") != 0 && strcmp(optarg, "exact") != 0) {
+                fprintf(stderr, HELP);
+                return -1;
+            }
+            exact_verification = strcmp(optarg, "exact") == 0;
+            break;
+        case 'k':
+            freivalds_rounds = atoi(optarg);
+            assert(freivalds_rounds > 0);
+            break;
+        case 'u':
+            should_autotune = 1;
+            break;
+        case 'P':
+            pin_threads = 1;
+            break;
+        case 'M':
+            mix_stream_types = 1;
+            break;
+        case 'e':
+            for (const char *letter = optarg; *letter; letter++) {
+                if (*letter == 'l') trmm_lower = 1;
+                else if (*letter == 't') trmm_transposed = 1;
+                else if (*letter == 'u') trmm_unit_diagonal = 1;
+                else {
+                    fprintf(stderr, HELP);
+                    return -1;
+                }
+            }
+            break;
+        case 'g':
+            alpha = atof(optarg);
+            break;
         default:
             fprintf(stderr, HELP);
             return -1;
         }
     }
 
+    if (precision != PRECISION_DOUBLE && (algorithm < 2 || algorithm > 5)) {
+        fprintf(stderr, "Precision %s is supported only by algorithms 2-5\n", precision_names[precision]);
+        return -1;
+    }
+    if (columns == 0)
+        columns = dimension_size;
+    int rectangular_supported = (algorithm >= 1 && algorithm <= 5) || algorithm == 9 || algorithm == 13 || algorithm == 15;
+    if (columns != dimension_size && (!rectangular_supported || benchmark_format)) {
+        fprintf(stderr, "Rectangular B is supported only by algorithms 1-5, 9, 13 and 15\n");
+        return -1;
+    }
+
+    // Note: pool is started before timed runs, so they do not include creating its threads
+    matrix_pool_init(omp_get_max_threads(), pin_threads);
+
+    matrix_type_t m1_type, m2_type;
+    int parallel;
+    int tunable = algorithm_types(algorithm, &m1_type, &m2_type, &parallel);
+    if (should_autotune && !tunable)
+        fprintf(stderr, "Algorithm %d could not be tuned\n", algorithm);
+    if (should_autotune && tunable) {
+        matrix_tuning_t tuning = matrix_autotune(m1_type, m2_type, parallel, dimension_size);
+        fprintf(
+            stderr, "Tuned: kernel %s block size %d kc %d mc %d\n",
+            tuning.kernel, tuning.block_size, tuning.kc, tuning.mc
+        );
+    }
+    if (benchmark_format) {
+        if (block_sizes_count == 0) {
+            block_size_list[0] = block_size ? block_size : DEFAULT_BLOCK_SIZE;
+            block_sizes_count = 1;
+        }
+        int result = benchmark(
+            algorithm, strcmp(benchmark_format, "json") == 0, dims_list, dims_count, block_size_list, block_sizes_count,
+            threads_list, threads_count, warmup, repetitions, strassen_cutoff, random_seed, pin_threads
+        );
+        write_trace();
+        return result;
+    }
+
+    if (block_size == 0) {
+        matrix_tuning_t tuning;
+        block_size = DEFAULT_BLOCK_SIZE;
+        if (tunable && matrix_tuning_lookup(m1_type, m2_type, parallel, dimension_size, &tuning))
+            block_size = tuning.block_size;
+    }
+
     if (block_size > dimension_size)
         block_size = dimension_size;
 
+    // Note: seeds random vectors of Freivalds verification
     srand(random_seed);
 
     double_matrix_t A = matrix_allocate_upper_triangular_cols(dimension_size);
-    double_matrix_t B = matrix_allocate(dimension_size, dimension_size);
+    double_matrix_t B = matrix_allocate(dimension_size, columns);
 
-    matrix_fill_random(A);
-    matrix_fill_random(B);
+    matrix_fill_random(A, random_seed, 0);
+    matrix_fill_random(B, random_seed, 1);
 
     double time_in_seconds;
+    double conversion_time_in_seconds = 0;
+    matrix_batch_stats_t batch_stats = { 0 };
     double_matrix_t result = matrix_allocate(A.nrows, B.ncols);
-    switch (algorithm) {
+    if (precision != PRECISION_DOUBLE) {
+        time_in_seconds = multiply_float(
+            algorithm, precision, A, B, &result, block_size, &conversion_time_in_seconds
+        );
+    } else switch (algorithm) {
         default:
             fprintf(stderr, HELP);
             return -1;
         case 1: {
-            double_matrix_t A_normal = matrix_convert_to_normal(A);
-            double_matrix_t B_normal = matrix_convert_to_normal(B);
+            double_matrix_t A_normal, B_normal;
+            TIME_ME(
+                A_normal = matrix_convert_to_normal(A);
+                B_normal = matrix_convert_to_normal(B),
+                conversion_time_in_seconds
+            );
             TIME_ME(
                 matrix_mult3(A_normal, B_normal, result),
                 time_in_seconds
@@ -129,9 +624,13 @@ int main(int argc, char *argv[]) {
             break;
         }
         case 3: {
-            double_matrix_t A_blocked = matrix_convert_to_upper_triangular_blocked(A, block_size);
-            double_matrix_t B_blocked = matrix_convert_to_normal_blocked(B, block_size);
-            result = matrix_convert_to_normal_blocked(result, block_size);
+            double_matrix_t A_blocked, B_blocked;
+            TIME_ME(
+                A_blocked = matrix_convert_to_upper_triangular_blocked(A, block_size);
+                B_blocked = matrix_convert_to_normal_blocked(B, block_size);
+                result = matrix_convert_to_normal_blocked(result, block_size),
+                conversion_time_in_seconds
+            );
             TIME_ME(
                 matrix_mult_block3(A_blocked, B_blocked, result, block_size),
                 time_in_seconds
@@ -145,14 +644,314 @@ int main(int argc, char *argv[]) {
             );
             break;
         }
+        case 5: {
+            double_matrix_t A_blocked, B_blocked;
+            TIME_ME(
+                A_blocked = matrix_convert_to_upper_triangular_blocked(A, block_size);
+                B_blocked = matrix_convert_to_normal_blocked(B, block_size);
+                result = matrix_convert_to_normal_blocked(result, block_size),
+                conversion_time_in_seconds
+            );
+            TIME_ME(
+                matrix_omp_mult_block3(A_blocked, B_blocked, result, block_size),
+                time_in_seconds
+            );
+            break;
+        }
+        case 6: {
+            double_matrix_t A_blocked, B_blocked;
+            TIME_ME(
+                A_blocked = matrix_convert_to_upper_triangular_blocked(A, block_size);
+                B_blocked = matrix_convert_to_normal_blocked(B, block_size);
+                result = matrix_convert_to_normal_blocked(result, block_size),
+                conversion_time_in_seconds
+            );
+            TIME_ME(
+                matrix_strassen_mult3(A_blocked, B_blocked, result, strassen_cutoff),
+                time_in_seconds
+            );
+            break;
+        }
+        case 7: {
+            // Note: first product of batch is A * B, so it is verified
+            double_matrix_t *As = malloc(sizeof(double_matrix_t) * batch_size);
+            double_matrix_t *Bs = malloc(sizeof(double_matrix_t) * batch_size);
+            double_matrix_t *results = malloc(sizeof(double_matrix_t) * batch_size);
+            As[0] = A;
+            Bs[0] = B;
+            results[0] = result;
+            for (int i = 1; i < batch_size; i++) {
+                As[i] = matrix_allocate_upper_triangular_cols(dimension_size);
+                Bs[i] = matrix_allocate(dimension_size, dimension_size);
+                results[i] = matrix_allocate(dimension_size, dimension_size);
+                matrix_fill_random(As[i], random_seed, 2 * i);
+                matrix_fill_random(Bs[i], random_seed, 2 * i + 1);
+            }
+            TIME_ME(
+                batch_stats = matrix_mult_batch(As, Bs, results, batch_size, block_size),
+                time_in_seconds
+            );
+            for (int i = 1; i < batch_size; i++) {
+                matrix_free(As[i]);
+                matrix_free(Bs[i]);
+                matrix_free(results[i]);
+            }
+            free(As);
+            free(Bs);
+            free(results);
+            break;
+        }
+        case 10: {
+            // Note: first product of stream is A * B, so it is verified below, the others are checked here
+            matrix_stream_t *stream = matrix_stream_create(block_size);
+            double_matrix_t *As = malloc(sizeof(double_matrix_t) * batch_size);
+            double_matrix_t *Bs = malloc(sizeof(double_matrix_t) * batch_size);
+            double_matrix_t *results = malloc(sizeof(double_matrix_t) * batch_size);
+            matrix_stream_job_t **jobs = malloc(sizeof(matrix_stream_job_t *) * batch_size);
+            As[0] = A;
+            Bs[0] = B;
+            results[0] = result;
+            for (int i = 1; i < batch_size; i++) {
+                // Note: with -M every second pair of products has triangular B, so slots, which held
+                // dense B of the same shape before, are reused for it and the other way round
+                As[i] = matrix_allocate_upper_triangular_cols(dimension_size);
+                Bs[i] = mix_stream_types && i / 2 % 2
+                    ? matrix_allocate_upper_triangular_cols(dimension_size)
+                    : matrix_allocate(dimension_size, dimension_size);
+                results[i] = matrix_allocate(dimension_size, dimension_size);
+                matrix_fill_random(As[i], random_seed, 2 * i);
+                matrix_fill_random(Bs[i], random_seed, 2 * i + 1);
+            }
+            TIME_ME(
+                for (int i = 0; i < batch_size; i++)
+                    jobs[i] = matrix_stream_submit(stream, As[i], Bs[i], results[i]);
+                for (int i = 0; i < batch_size; i++)
+                    matrix_stream_wait(stream, jobs[i]),
+                time_in_seconds
+            );
+            matrix_stream_destroy(stream);
+            for (int i = 1; i < batch_size && should_verify; i++)
+                if (!matrix_freivalds_verify(As[i], Bs[i], results[i], freivalds_rounds, tolerances[precision])) {
+                    fprintf(stderr, "Verification of product %d failed!\n", i);
+                    return -1;
+                }
+            for (int i = 1; i < batch_size; i++) {
+                matrix_free(As[i]);
+                matrix_free(Bs[i]);
+                matrix_free(results[i]);
+            }
+            free(As);
+            free(Bs);
+            free(results);
+            free(jobs);
+            batch_stats.flops = matrix_mult_flops(A, B) * batch_size;
+            batch_stats.seconds = time_in_seconds;
+            batch_stats.gflops = batch_stats.flops / time_in_seconds / 1e9;
+            break;
+        }
+        case 8: {
+            // Note: matrices are written to files first, multiplication reads them only
+            // through mappings, so they could be larger than physical memory
+            char A_path[1024], B_path[1024], C_path[1024];
+            snprintf(A_path, sizeof(A_path), "%s/A.matrix", files_directory);
+            snprintf(B_path, sizeof(B_path), "%s/B.matrix", files_directory);
+            snprintf(C_path, sizeof(C_path), "%s/C.matrix", files_directory);
+            double_matrix_t A_blocked = matrix_convert_to_upper_triangular_blocked(A, block_size);
+            double_matrix_t B_blocked = matrix_convert_to_normal_blocked(B, block_size);
+            double_matrix_t A_mapped, B_mapped, C_mapped;
+            int ok = matrix_save(A_blocked, A_path) && matrix_save(B_blocked, B_path);
+            matrix_free(A_blocked);
+            matrix_free(B_blocked);
+            ok = ok && matrix_map(A_path, 0, &A_mapped) && matrix_map(B_path, 0, &B_mapped)
+                && matrix_map_create(C_path, NORMAL_BLOCKED, dimension_size, dimension_size, block_size, &C_mapped);
+            if (!ok) return -1;
+            TIME_ME(
+                matrix_out_of_core_mult3(A_mapped, B_mapped, C_mapped, memory_budget),
+                time_in_seconds
+            );
+            matrix_convert(C_mapped, result);
+            matrix_unmap(A_mapped);
+            matrix_unmap(B_mapped);
+            matrix_unmap(C_mapped);
+            unlink(A_path);
+            unlink(B_path);
+            unlink(C_path);
+            break;
+        }
+        case 11: {
+            // Note: B itself is made banded too, so verification multiplies the same matrix
+            int blocks = matrix_blocks(dimension_size, block_size);
+            char *band = malloc((size_t) blocks * blocks);
+            for (int block_i = 0; block_i < blocks; block_i++)
+                for (int block_j = 0; block_j < blocks; block_j++)
+                    band[(size_t) block_i * blocks + block_j] = abs(block_i - block_j) <= band_blocks;
+            double_matrix_t B_sparse = matrix_allocate_sparse_blocked(dimension_size, dimension_size, block_size, band);
+            free(band);
+            matrix_convert(B, B_sparse);
+            matrix_convert(B_sparse, B);
+
+            double_matrix_t A_blocked;
+            TIME_ME(
+                A_blocked = matrix_convert_to_upper_triangular_blocked(A, block_size);
+                result = matrix_convert_to_normal_blocked(result, block_size),
+                conversion_time_in_seconds
+            );
+            TIME_ME(
+                matrix_omp_mult_block3(A_blocked, B_sparse, result, block_size),
+                time_in_seconds
+            );
+            break;
+        }
+        case 12: {
+            double_matrix_t A2 = matrix_allocate_upper_triangular_cols(dimension_size);
+            matrix_fill_random(A2, random_seed, 2);
+            matrix_expr_t *a = matrix_expr_leaf(A), *a2 = matrix_expr_leaf(A2), *b = matrix_expr_leaf(B);
+            matrix_expr_t *a_a2 = matrix_expr_mult(a, a2), *chain = matrix_expr_mult(a_a2, b);
+            double_matrix_t chain_result;
+            TIME_ME(
+                chain_result = matrix_expr_eval(chain, block_size),
+                time_in_seconds
+            );
+            TIME_ME(
+                matrix_convert(chain_result, result),
+                conversion_time_in_seconds
+            );
+            matrix_free(chain_result);
+            matrix_expr_free(a);
+            matrix_expr_free(a2);
+            matrix_expr_free(b);
+            matrix_expr_free(a_a2);
+            matrix_expr_free(chain);
+            // Note: result is verified as A * (A2 * B) with reference product A2 * B
+            if (should_verify) {
+                double_matrix_t A2_normal = matrix_convert_to_normal(A2);
+                double_matrix_t A2_B = matrix_allocate(dimension_size, columns);
+                matrix_reference_mult3(A2_normal, B, A2_B);
+                matrix_free(A2_normal);
+                matrix_free(B);
+                B = A2_B;
+            }
+            matrix_free(A2);
+            break;
+        }
+        case 13: {
+            // Note: arrays stand for memory of caller, views start inside of them
+            // and have leading dimensions bigger than their sizes
+            int margin = 3;
+            int B_ld = dimension_size + 2 * margin, C_ld = columns + 2 * margin;
+            double *B_array = malloc(sizeof(double) * B_ld * (columns + margin));
+            double *C_array = calloc((size_t) (dimension_size + margin) * C_ld, sizeof(double));
+            double_matrix_t B_view = matrix_subview(
+                matrix_view(B_array, B_ld, columns + margin, B_ld, 1), margin, margin, dimension_size, columns
+            );
+            double_matrix_t C_view = matrix_subview(
+                matrix_view(C_array, dimension_size + margin, C_ld, C_ld, 0), margin, margin, dimension_size, columns
+            );
+            matrix_convert(B, B_view);
+            TIME_ME(
+                matrix_omp_mult_block3(A, B_view, C_view, block_size),
+                time_in_seconds
+            );
+            matrix_convert(C_view, result);
+            free(B_array);
+            free(C_array);
+            break;
+        }
+        case 14: {
+            // Note: products are the same, only the last one is kept for verification
+            double_matrix_t A_blocked, B_blocked, C_blocked;
+            TIME_ME(
+                A_blocked = matrix_convert_to_upper_triangular_blocked(A, block_size);
+                B_blocked = matrix_convert_to_normal_blocked(B, block_size),
+                conversion_time_in_seconds
+            );
+            // Note: workspace of Strassen-Winograd is smaller than C
+            size_t C_size = sizeof(double) * matrix_storage_size(NORMAL_BLOCKED, dimension_size, dimension_size, block_size);
+            matrix_arena_t *arena = matrix_arena_create(2 * (C_size + 2 * MATRIX_ALIGNMENT));
+            matrix_arena_t *previous_arena = matrix_arena_use(arena);
+            TIME_ME(
+                for (int i = 0; i < batch_size; i++) {
+                    matrix_arena_reset(arena);
+                    C_blocked = matrix_allocate_blocked(dimension_size, block_size);
+                    matrix_strassen_mult3(A_blocked, B_blocked, C_blocked, strassen_cutoff);
+                },
+                time_in_seconds
+            );
+            matrix_arena_use(previous_arena);
+            matrix_convert(C_blocked, result);
+            matrix_arena_destroy(arena);
+            batch_stats.flops = matrix_mult_flops(A, B) * batch_size;
+            batch_stats.seconds = time_in_seconds;
+            batch_stats.gflops = batch_stats.flops / time_in_seconds / 1e9;
+            break;
+        }
+        case 9: {
+            // Note: result is copy of B only because B is needed for verification
+            memcpy(result.data, B.data, sizeof(double) * dimension_size * columns);
+            if (!trmm_lower && !trmm_transposed && !trmm_unit_diagonal && alpha == 1) {
+                TIME_ME(
+                    matrix_trmm(0, 0, 0, 1.0, A, result, block_size),
+                    time_in_seconds
+                );
+                break;
+            }
+            // Note: other variants read triangle of dense A, the other triangle (and diagonal with
+            // unit diagonal) is random too, so it is checked that they are not read
+            double_matrix_t A_dense = matrix_allocate(dimension_size, dimension_size);
+            matrix_fill_random(A_dense, random_seed, 2);
+            TIME_ME(
+                matrix_trmm(trmm_lower, trmm_transposed, trmm_unit_diagonal, alpha, A_dense, result, block_size),
+                time_in_seconds
+            );
+            if (should_verify) {
+                matrix_free(A);
+                A = explicit_operand(A_dense, trmm_lower, trmm_transposed, trmm_unit_diagonal, alpha);
+            }
+            matrix_free(A_dense);
+            break;
+        }
+        case 15: {
+            // Note: C is filled with NaN, so the first product must overwrite it
+            double_matrix_t A_normal = matrix_convert_to_normal(A);
+            // Note: with -d 1 inner dimension is not split, the only product overwrites C
+            int half = dimension_size / 2;
+            for (size_t i = 0; i < (size_t) dimension_size * columns; i++)
+                ((double *) result.data)[i] = NAN;
+            TIME_ME(
+                if (half > 0)
+                    matrix_gemm(
+                        alpha, matrix_subview(A_normal, 0, 0, dimension_size, half), matrix_subview(B, 0, 0, half, columns),
+                        0, result, block_size
+                    );
+                matrix_gemm(
+                    alpha, matrix_subview(A_normal, 0, half, dimension_size, dimension_size - half),
+                    matrix_subview(B, half, 0, dimension_size - half, columns), half > 0, result, block_size
+                ),
+                time_in_seconds
+            );
+            if (should_verify && alpha != 1) {
+                matrix_free(A);
+                A = explicit_operand(A_normal, 0, 0, 0, alpha);
+            }
+            matrix_free(A_normal);
+            break;
+        }
     }
 
     if (should_verify) {
-        double_matrix_t A_normal = matrix_convert_to_normal(A);
-        double_matrix_t B_normal = matrix_convert_to_normal(B);
-        double_matrix_t expected = matrix_allocate(A_normal.nrows, B_normal.ncols);
-        matrix_mult3(A_normal, B_normal, expected);
-        if (!verify(expected, result)) {
+        int ok;
+        if (exact_verification) {
+            double_matrix_t A_normal = matrix_convert_to_normal(A);
+            double_matrix_t B_normal = matrix_convert_to_normal(B);
+            double_matrix_t expected = matrix_allocate(A_normal.nrows, B_normal.ncols);
+            matrix_reference_mult3(A_normal, B_normal, expected);
+            if (algorithm == 6 || algorithm == 14 || precision != PRECISION_DOUBLE)
+                report_accuracy(expected, result);
+            ok = matrix_compare(expected, result, tolerances[precision] * root_mean_square(expected), tolerances[precision], MAX_ULPS);
+        } else {
+            ok = matrix_freivalds_verify(A, B, result, freivalds_rounds, tolerances[precision]);
+        }
+        if (!ok) {
             fprintf(stderr, "Verification failed!\n");
             return -1;
         }
@@ -160,6 +959,11 @@ int main(int argc, char *argv[]) {
 
     if (print_elapsed_time)
         printf("%.3f\n", time_in_seconds);
+    if (print_conversion_time)
+        printf("%.3f\n", conversion_time_in_seconds);
+    if (algorithm == 7 || algorithm == 10 || algorithm == 14)
+        printf("%.3f GFLOP/s\n", batch_stats.gflops);
 
+    write_trace();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "matrix.h"
+#include "summa.h"
+#include "trace.h"
+#include <omp.h>
+#include <getopt.h>
+
+#define DEFAULT_DIM_SIZE 2880
+#define DEFAULT_BLOCK_SIZE (DEFAULT_DIM_SIZE / 16)
+
+#define ROOT 0
+
+// Note: allowed error relative to bound of rounding errors of row, see matrix_freivalds_verify
+#define TOLERANCE 1e-10
+#define FREIVALDS_ROUNDS 8
+
+#define HELP \
+    "Program for benchamrking of distributed matrix multiplication, run with mpirun -np N\n" \
+    "\t A * B = C\n" \
+    "where:\n" \
+    "\tA - upper triangular matrix\n" \
+    "\tB - square matrix\n" \
+    "Blocks are distributed between ranks 2D block-cyclic, every rank generates its own blocks,\n" \
+    "product is computed with SUMMA and verified with distributed Freivalds' algorithm\n" \
+    "\nOptions:\n" \
+    "\t-n - no verify, disable Freivalds verification after run\n" \
+    "\t-d - set matrix dimension size (default 2880)\n" \
+    "\t-b - set matrix block size (default 2880 / 16)\n" \
+    "\t-s - set seed for random matrix fill\n" \
+    "\t-g - gather product to root and verify it against matrices generated there, for sizes\n" \
+    "\t     fitting in memory of one rank\n" \
+    "\t-t - print elapsed time of multiplication (without generation and verification)\n"
+
+int main(int argc, char *argv[]) {
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    assert(provided >= MPI_THREAD_FUNNELED);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    int dimension_size = DEFAULT_DIM_SIZE;
+    int block_size = DEFAULT_BLOCK_SIZE;
+    int random_seed = 42;
+    int print_elapsed_time = 0;
+    int should_verify = 1;
+    int should_gather = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:b:s:tng")) != -1) {
+        switch (opt) {
+        case 'd':
+            dimension_size = atoi(optarg);
+            assert(dimension_size > 0);
+            break;
+        case 'b':
+            block_size = atoi(optarg);
+            assert(block_size > 0);
+            break;
+        case 's':
+            random_seed = atoi(optarg);
+            break;
+        case 't':
+            print_elapsed_time = 1;
+            break;
+        case 'n':
+            should_verify = 0;
+            break;
+        case 'g':
+            should_gather = 1;
+            break;
+        default:
+            if (rank == ROOT) fprintf(stderr, HELP);
+            MPI_Finalize();
+            return -1;
+        }
+    }
+
+    if (block_size > dimension_size)
+        block_size = dimension_size;
+
+    matrix_summa_grid_t grid;
+    matrix_summa_grid_create(MPI_COMM_WORLD, dimension_size, block_size, &grid);
+    double *A_local = matrix_summa_allocate_local(&grid);
+    double *B_local = matrix_summa_allocate_local(&grid);
+    double *C_local = matrix_summa_allocate_local(&grid);
+
+    // Note: every rank generates its own blocks with the same values as main.c gives to whole
+    // matrices, so results are comparable and no rank holds more than its part
+    matrix_summa_fill_random(&grid, A_local, 1, random_seed, 0);
+    matrix_summa_fill_random(&grid, B_local, 0, random_seed, 1);
+    if (rank == ROOT) srand(random_seed);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    matrix_summa_mult3(&grid, A_local, B_local, C_local, 1);
+    MPI_Barrier(MPI_COMM_WORLD);
+    double time_in_seconds = MPI_Wtime() - start;
+
+    int result_code = 0;
+    if (should_verify && !matrix_summa_freivalds_verify(&grid, A_local, B_local, C_local, FREIVALDS_ROUNDS, TOLERANCE)) {
+        if (rank == ROOT) fprintf(stderr, "Verification failed!\n");
+        result_code = -1;
+    }
+
+    if (should_gather) {
+        double_matrix_t C_blocked = { 0 };
+        if (rank == ROOT)
+            C_blocked = matrix_allocate_blocked(dimension_size, block_size);
+        matrix_summa_gather(&grid, C_local, C_blocked, ROOT);
+        if (rank == ROOT) {
+            double_matrix_t A = matrix_allocate_upper_triangular_cols(dimension_size);
+            double_matrix_t B = matrix_allocate(dimension_size, dimension_size);
+            matrix_fill_random(A, random_seed, 0);
+            matrix_fill_random(B, random_seed, 1);
+            if (!matrix_freivalds_verify(A, B, C_blocked, FREIVALDS_ROUNDS, TOLERANCE)) {
+                fprintf(stderr, "Verification of gathered product failed!\n");
+                result_code = -1;
+            }
+            matrix_free(A);
+            matrix_free(B);
+            matrix_free(C_blocked);
+        }
+    }
+
+    if (rank == ROOT && print_elapsed_time)
+        printf("%.3f\n", time_in_seconds);
+
+    // Note: every rank writes its own trace, does nothing unless built with make TRACE=1
+    char trace_path[64];
+    snprintf(trace_path, sizeof(trace_path), "matrix_trace.%d.json", rank);
+    if (!MATRIX_TRACE_WRITE(trace_path))
+        fprintf(stderr, "Could not write trace to %s\n", trace_path);
+
+    free(A_local);
+    free(B_local);
+    free(C_local);
+    matrix_summa_grid_free(&grid);
+    MPI_Bcast(&result_code, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
+    MPI_Finalize();
+    return result_code;
+}
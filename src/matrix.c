@@ -1,32 +1,73 @@
 #include "matrix.h"
+#include "kernel.h"
+#include "trace.h"
+#include "pool.h"
 #include <omp.h>
 #include <stdio.h>
 
-#define MIN(x, y) ((x < y) ? (x) : (y))
-#define MAX(x, y) ((x < y) ? (y) : (x))
-
-static double random_double() {
-    union {
-        double d;
-        unsigned char uc[sizeof(double)];
-    } u;
+// SplitMix64 output function, different inputs give uncorrelated outputs
+static inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
 
-    do {
-        for (unsigned i = 0; i < sizeof(u.uc); i++) {
-            u.uc[i] = (unsigned char) rand();
-        }
-    } while (!isfinite(u.d));
+// Note: counter-based, element (i, j) is hash of its indices, so value does not depend on
+// layout or on order of generation. Uniform in [-10, 10)
+static inline double random_double(uint64_t key, int i, int j) {
+    uint64_t bits = mix64(key + (((uint64_t) i << 32 | (uint32_t) j) * 0x9e3779b97f4a7c15ull));
+    return (double) (bits >> 11) * 0x1p-53 * 20.0 - 10.0;
+}
 
-    while (u.d > 10.0 || u.d < -10.0) u.d /= 10.0;
+static inline uint64_t random_key(uint64_t seed, uint64_t stream) {
+    return mix64(seed ^ mix64(stream));
+}
 
-    return u.d;
+double matrix_random_value(uint64_t seed, uint64_t stream, int i, int j) {
+    return random_double(random_key(seed, stream), i, j);
 }
 
-void matrix_fill_random(double_matrix_t matrix) {
-    for (int i = 0; i < matrix.nrows; i++)
+void matrix_fill_random(double_matrix_t matrix, uint64_t seed, uint64_t stream) {
+    uint64_t key = random_key(seed, stream);
+    double *plain = (double *) matrix.data;
+    switch (matrix.type) {
+    case NORMAL:
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < matrix.nrows; i++)
+            for (int j = 0; j < matrix.ncols; j++)
+                plain[matrix_normal_offset(matrix, i, j)] = random_double(key, i, j);
+        break;
+    case UPPER_TRIANGULAR_COLS:
+        #pragma omp parallel for schedule(dynamic, 16)
         for (int j = 0; j < matrix.ncols; j++)
-            if (matrix_index_in_matrix(matrix, i, j))
-                matrix_set(matrix, i, j, random_double());
+            for (int i = 0; i <= j && i < matrix.nrows; i++)
+                plain[(size_t) j * (j + 1) / 2 + i] = random_double(key, i, j);
+        break;
+    case NORMAL_BLOCKED:
+    case UPPER_TRIANGULAR_BLOCKED:
+    case SPARSE_BLOCKED: {
+        int block_size = matrix.minfo.blocked_info.block_size;
+        int blocks_in_row = matrix.minfo.blocked_info.blocks_in_row;
+        int blocks_in_col = matrix_blocks(matrix.nrows, block_size);
+        // Note: every block is filled by one thread
+        #pragma omp parallel for collapse(2) schedule(dynamic)
+        for (int block_i = 0; block_i < blocks_in_col; block_i++)
+            for (int block_j = 0; block_j < blocks_in_row; block_j++) {
+                if (matrix.type == UPPER_TRIANGULAR_BLOCKED && block_i > block_j) continue;
+                if (matrix.type == SPARSE_BLOCKED && matrix_sparse_entry(matrix, block_i, block_j) < 0) continue;
+                double *block = (double *) matrix_blocked_subblock(matrix, block_i * block_size, block_j * block_size).data;
+                for (int i = 0; i < block_size; i++)
+                    for (int j = 0; j < block_size; j++) {
+                        int global_i = block_i * block_size + i, global_j = block_j * block_size + j;
+                        // Note: padding of edge blocks stays zero
+                        block[i * block_size + j] = matrix_index_in_matrix(matrix, global_i, global_j)
+                            ? random_double(key, global_i, global_j) : 0;
+                    }
+            }
+        break;
+    }
+    }
 }
 
 void matrix_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out) {
@@ -43,148 +84,460 @@ void matrix_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out) {
     }
 }
 
-// TODO we can make better specilazation: make matrix_get/set more optimized
-void matrix_mult_block3_UPPER_TRIANGULAR_COLS_NORMAL_specialization(
-    double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size
+// Number of tasks of pool per worker, more tasks balance better, longer tasks reuse packed panels
+#define TASKS_PER_THREAD 8
+
+// Every task of pool multiplies segment of tiles_per_task tiles in one row of tiles of out,
+// it accumulates them over all k privately, so no synchronization is needed on out.
+// Tiles of segment are multiplied together to reuse packed panel of m1
+typedef struct {
+    double_matrix_t m1;
+    double_matrix_t m2;
+    double_matrix_t out;
+    int block_max_size;
+    // Note: kernel of precision of tasks, matrix_kernel_t or matrix_kernel_float_t
+    const void *kernel;
+    int tiles_in_row;
+    int tiles_per_task;
+    int tasks_in_row;
+} tiles_job_t;
+
+static inline void task_tiles(const tiles_job_t *job, int task, int *tile_i, int *tile_j_start, int *tile_j_end) {
+    *tile_i = task / job->tasks_in_row;
+    *tile_j_start = task % job->tasks_in_row * job->tiles_per_task;
+    *tile_j_end = MIN(job->tiles_in_row, *tile_j_start + job->tiles_per_task);
+}
+
+// Splits every row of tiles of out into at most tasks_in_row segments
+static tiles_job_t tiles_job(
+    double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const void *kernel, int tasks_in_row
 ) {
-    assert(m1.type == UPPER_TRIANGULAR_COLS && m2.type == NORMAL);
+    int tiles_in_row = matrix_blocks(out.ncols, block_max_size);
+    tiles_job_t job = {
+        .m1 = m1,
+        .m2 = m2,
+        .out = out,
+        .block_max_size = block_max_size,
+        .kernel = kernel,
+        .tiles_in_row = tiles_in_row,
+        .tiles_per_task = matrix_blocks(tiles_in_row, tasks_in_row),
+    };
+    job.tasks_in_row = matrix_blocks(tiles_in_row, job.tiles_per_task);
+    return job;
+}
 
-    for (int block_start_i = 0; block_start_i < out.nrows; block_start_i += block_max_size) {
-        for (int block_start_j = 0; block_start_j < out.ncols; block_start_j += block_max_size) {
-            for (int block_start_k = 0; block_start_k < m2.nrows; block_start_k += block_max_size) {
-                // Since m1 is UPPER_TRIANGULAR we can skip all blocks when block_start_i > block_start_k
-                // (they are zeroed)
-                if (block_start_i > block_start_k) continue;
-                for (int i = block_start_i; i < MIN(out.nrows, block_start_i + block_max_size); i++) {
-                    for (int j = block_start_j; j < MIN(out.ncols, block_start_j + block_max_size); j++) {
-                        double val = matrix_get(out, i, j);
-                        // Note: use k = MAX(i, block_start_k) because m1 is UPPER TRIANGULAR matrix,
-                        // and all k < i are 0
-                        // TODO might be optimized more if we simply skip blocks were
-                        // MAX(i, block_start_k) >= MIN(m2.nrows, block_start_k + block_max_size)
-                        for (int k = MAX(i, block_start_k); k < MIN(m2.nrows, block_start_k + block_max_size); k++)
-                            val += matrix_get_UPPER_TRIANGULAR(m1, i, k) * matrix_get_NORMAL(m2, k, j);
-                        matrix_set(out, i, j, val);
-                    }
-                }
-            }
-        }
+static inline __attribute__((always_inline)) int is_upper_triangular(matrix_type_t type) {
+    return type == UPPER_TRIANGULAR_COLS || type == UPPER_TRIANGULAR_BLOCKED;
+}
+
+// Stored blocks of block row block_i of blocked matrix m, which lie in block columns
+// [block_j_start, block_j_end), are entries [*start, *end) of this row
+static inline __attribute__((always_inline)) void block_row_entries(
+    double_matrix_t m, matrix_type_t type, int block_i, int block_j_start, int block_j_end, int *start, int *end
+) {
+    if (type != SPARSE_BLOCKED) {
+        // Note: entries of dense rows are block columns, blocks under diagonal of
+        // UPPER_TRIANGULAR_BLOCKED are skipped
+        *start = type == UPPER_TRIANGULAR_BLOCKED ? MAX(block_i, block_j_start) : block_j_start;
+        *end = block_j_end;
+        return;
     }
+    const int *cols = m.minfo.blocked_info.block_cols;
+    int row_end = m.minfo.blocked_info.row_starts[block_i + 1];
+    int entry = m.minfo.blocked_info.row_starts[block_i];
+    while (entry < row_end && cols[entry] < block_j_start) entry++;
+    *start = entry;
+    while (entry < row_end && cols[entry] < block_j_end) entry++;
+    *end = entry;
 }
 
-// TODO we can make better specilazation: make matrix_get/set more optimized
-void matrix_mult_block3_UPPER_TRIANGULAR_BLOCKED_NORMAL_BLOCKED_specialization(
-    double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size
+static inline __attribute__((always_inline)) int block_entry_col(double_matrix_t m, matrix_type_t type, int entry) {
+    return type == SPARSE_BLOCKED ? m.minfo.blocked_info.block_cols[entry] : entry;
+}
+
+// Offset in elements of stored block of blocked matrix m, which contains element (i, j)
+static inline __attribute__((always_inline)) size_t block_offset(double_matrix_t m, int i, int j) {
+    int block_size = m.minfo.blocked_info.block_size;
+    return matrix_blocked_block_index(m, i / block_size, j / block_size) * block_size * block_size;
+}
+
+// Offset in elements of block of entry of block row block_i, see block_row_entries
+static inline __attribute__((always_inline)) size_t block_entry_offset(
+    double_matrix_t m, matrix_type_t type, int block_i, int entry, int block_size
 ) {
-    assert(m1.type == UPPER_TRIANGULAR_BLOCKED && m2.type == NORMAL_BLOCKED && out.type == NORMAL_BLOCKED);
-    assert(m1.minfo.blocked_info.block_size == block_max_size);
-    assert(m2.minfo.blocked_info.block_size == block_max_size);
+    size_t index = type == SPARSE_BLOCKED ? (size_t) entry : matrix_blocked_block_index(m, block_i, entry);
+    return index * block_size * block_size;
+}
 
-    for (int block_start_i = 0; block_start_i < out.nrows; block_start_i += block_max_size) {
-        for (int block_start_j = 0; block_start_j < out.ncols; block_start_j += block_max_size) {
-            for (int block_start_k = 0; block_start_k < m2.nrows; block_start_k += block_max_size) {
-                // Since m1 is UPPER_TRIANGULAR we can skip all blocks when block_start_i > block_start_k
-                // (they are zeroed)
-                if (block_start_i > block_start_k) continue;
-                double_matrix_t m1_subblock = matrix_blocked_subblock(m1, block_start_i, block_start_k);
-                double_matrix_t m2_subblock = matrix_blocked_subblock(m2, block_start_k, block_start_j);
-                double_matrix_t out_subblock = matrix_blocked_subblock(out, block_start_i, block_start_j);
-                for (int i = 0; i < block_max_size; i++) {
-                    for (int j = 0; j < block_max_size; j++) {
-                        double val = 0;
-                        for (int k = 0; k < block_max_size; k++)
-                            val += matrix_get_NORMAL(m1_subblock, i, k) * matrix_get_NORMAL(m2_subblock, k, j);
-                        matrix_add_NORMAL(out_subblock, i, j, val);
-                    }
-                }
-            }
+// Runs tasks for all segments of tiles of out on pool. Workers start from contiguous ranges
+// of tasks, for triangular m1 ranges are balanced by FLOP count, and steal tasks from
+// the ends of ranges of others when they finish their own
+static void matrix_pool_mult_block3(
+    double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const void *kernel, matrix_pool_task_t task
+) {
+    int threads = matrix_pool_threads();
+    int tiles_in_col = matrix_blocks(out.nrows, block_max_size);
+    int tiles_in_row = matrix_blocks(out.ncols, block_max_size);
+    // Note: single worker multiplies whole rows of tiles
+    int tasks_in_row = threads == 1 ? 1 : MIN(tiles_in_row, matrix_blocks(TASKS_PER_THREAD * threads, tiles_in_col));
+    tiles_job_t job = tiles_job(m1, m2, out, block_max_size, kernel, tasks_in_row);
+
+    int *bounds = NULL;
+    // Note: cost of tasks with sparse or triangular m2 does not follow triangle of m1,
+    // they start from equal ranges and are balanced by stealing
+    if (is_upper_triangular(m1.type) && (m2.type == NORMAL || m2.type == NORMAL_BLOCKED)) {
+        // Note: bounds are reused by later calls of the same thread like packing buffers,
+        // bound inside of segment of tiles is rounded up to the next task
+        bounds = (int *) matrix_kernel_scratch(MATRIX_KERNEL_SCRATCH_BOUNDS, threads + 1);
+        matrix_kernel_partition_upper_triangular(out.nrows, out.ncols, m2.nrows, block_max_size, threads, bounds);
+        for (int thread = 0; thread <= threads; thread++) {
+            int tile_i = bounds[thread] / tiles_in_row, tile_j = bounds[thread] % tiles_in_row;
+            bounds[thread] = tile_i * job.tasks_in_row + matrix_blocks(tile_j, job.tiles_per_task);
         }
     }
+    matrix_pool_run(tiles_in_col * job.tasks_in_row, bounds, task, &job);
 }
 
-void matrix_omp_mult_block3_UPPER_TRIANGULAR_COLS_NORMAL_specialization(
+void matrix_mult_block3_no_specialization(
     double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size
 ) {
-    assert(m1.type == UPPER_TRIANGULAR_COLS && m2.type == NORMAL && out.type == NORMAL);
-
-    #pragma omp parallel
-    #pragma omp single
-    {
     for (int block_start_i = 0; block_start_i < out.nrows; block_start_i += block_max_size) {
         for (int block_start_j = 0; block_start_j < out.ncols; block_start_j += block_max_size) {
             for (int block_start_k = 0; block_start_k < m2.nrows; block_start_k += block_max_size) {
-                #pragma omp task
-                #pragma omp private(block_start_i, block_start_j, block_start_k)
-                {
                 for (int i = block_start_i; i < MIN(out.nrows, block_start_i + block_max_size); i++) {
                     for (int j = block_start_j; j < MIN(out.ncols, block_start_j + block_max_size); j++) {
-                        double val = 0;
-                        // Note: use k = MAX(i, block_start_k) because m1 is UPPER TRIANGULAR matrix,
-                        // and all k < i are 0
-                        // TODO might be optimized more if we simply skip blocks were
-                        // MAX(i, block_start_k) >= MIN(m2.nrows, block_start_k + block_max_size)
-                        for (int k = MAX(i, block_start_k); k < MIN(m2.nrows, block_start_k + block_max_size); k++)
-                            val += matrix_get_UPPER_TRIANGULAR(m1, i, k) * matrix_get_NORMAL(m2, k, j);
-                        matrix_add_NORMAL(out, i, j, val);
+                        double val = matrix_get_or_zero(out, i, j);
+                            for (int k = block_start_k; k < MIN(m2.nrows, block_start_k + block_max_size); k++)
+                                val += matrix_get_or_zero(m1, i, k) * matrix_get_or_zero(m2, k, j);
+                        matrix_set(out, i, j, val);
                     }
                 }
-                }
             }
         }
     }
-        #pragma omp taskwait
-    }
+
+    return;
 }
 
-void matrix_mult_block3_no_specialization(
+// Each thread computes whole tiles of out, so matrix_set is never called
+// concurrently for the same element
+void matrix_omp_mult_block3_no_specialization(
     double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size
 ) {
-    for (int block_start_i = 0; block_start_i < out.nrows; block_start_i += block_max_size) {
-        for (int block_start_j = 0; block_start_j < out.ncols; block_start_j += block_max_size) {
+    int tiles_in_col = (out.nrows + block_max_size - 1) / block_max_size;
+    int tiles_in_row = (out.ncols + block_max_size - 1) / block_max_size;
+
+    #pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int tile_i = 0; tile_i < tiles_in_col; tile_i++) {
+        for (int tile_j = 0; tile_j < tiles_in_row; tile_j++) {
+            int block_start_i = tile_i * block_max_size;
+            int block_start_j = tile_j * block_max_size;
             for (int block_start_k = 0; block_start_k < m2.nrows; block_start_k += block_max_size) {
                 for (int i = block_start_i; i < MIN(out.nrows, block_start_i + block_max_size); i++) {
                     for (int j = block_start_j; j < MIN(out.ncols, block_start_j + block_max_size); j++) {
-                        double val = matrix_get_or_zero(out, i, j);
-                            for (int k = block_start_k; k < MIN(m2.nrows, block_start_k + block_max_size); k++)
-                                val += matrix_get_or_zero(m1, i, k) * matrix_get_or_zero(m2, k, j);
+                        if (!matrix_index_in_matrix(out, i, j)) continue;
+                        double val = matrix_get(out, i, j);
+                        for (int k = block_start_k; k < MIN(m2.nrows, block_start_k + block_max_size); k++)
+                            val += matrix_get_or_zero(m1, i, k) * matrix_get_or_zero(m2, k, j);
                         matrix_set(out, i, j, val);
                     }
                 }
             }
         }
     }
+}
 
-    return;
+// Kernel registry: every specialization is instantiated for each of SPECIALIZED_BLOCK_SIZES
+// with block size known at compile time (so packing and macro-kernel loops have fixed
+// trip counts), and once more with block size passed in runtime for all other sizes
+#define SPECIALIZED_BLOCK_SIZES(F, M1, M2, OUT) \
+    F(M1, M2, OUT, 16) \
+    F(M1, M2, OUT, 32) \
+    F(M1, M2, OUT, 64) \
+    F(M1, M2, OUT, 80) \
+    F(M1, M2, OUT, 120)
+
+// Types of m1, m2 and out with specializations
+#define SPECIALIZED_TYPES(F) \
+    F(NORMAL, NORMAL, NORMAL) \
+    F(UPPER_TRIANGULAR_COLS, NORMAL, NORMAL) \
+    F(UPPER_TRIANGULAR_BLOCKED, NORMAL_BLOCKED, NORMAL_BLOCKED) \
+    F(SPARSE_BLOCKED, NORMAL_BLOCKED, NORMAL_BLOCKED) \
+    F(NORMAL_BLOCKED, SPARSE_BLOCKED, NORMAL_BLOCKED) \
+    F(SPARSE_BLOCKED, SPARSE_BLOCKED, NORMAL_BLOCKED) \
+    F(UPPER_TRIANGULAR_BLOCKED, SPARSE_BLOCKED, NORMAL_BLOCKED) \
+    F(NORMAL_BLOCKED, NORMAL_BLOCKED, NORMAL_BLOCKED) \
+    F(NORMAL_BLOCKED, UPPER_TRIANGULAR_BLOCKED, NORMAL_BLOCKED) \
+    F(UPPER_TRIANGULAR_BLOCKED, UPPER_TRIANGULAR_BLOCKED, UPPER_TRIANGULAR_BLOCKED)
+
+#define MATRIX_TYPES_COUNT 5
+
+typedef void (*matrix_mult_kernel_t)(
+    double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const matrix_kernel_t *kernel
+);
+
+enum {
+    BLOCK_SIZE_ANY,
+#define F(M1, M2, OUT, BS) BLOCK_SIZE_##BS,
+    SPECIALIZED_BLOCK_SIZES(F, _, _, _)
+#undef F
+    BLOCK_SIZES_COUNT
+};
+
+static inline int block_size_slot(int block_size) {
+    switch (block_size) {
+#define F(M1, M2, OUT, BS) case BS: return BLOCK_SIZE_##BS;
+    SPECIALIZED_BLOCK_SIZES(F, _, _, _)
+#undef F
+    default:
+        return BLOCK_SIZE_ANY;
+    }
+}
+
+// Functions of registry are generated for every precision by specializations.h, matrices
+// are descriptors of layout and data of float ones is float (see matrix_float_layout)
+#define PRECISION_CONCAT_(A, B) A##_##B
+#define PRECISION_CONCAT(A, B) PRECISION_CONCAT_(A, B)
+#define PRECISION_FUNCTION(NAME) PRECISION_CONCAT(PRECISION_PREFIX, NAME)
+
+#define DEFINE_SIZED_KERNELS(M1, M2, OUT, BS) \
+    static void PRECISION_FUNCTION(mult_block3_##M1##_##M2##_##BS)( \
+        double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const matrix_kernel_t *tuned \
+    ) { \
+        assert(block_max_size == BS); \
+        KERNEL_T kernel = PRECISION_KERNEL(tuned); \
+        PRECISION_FUNCTION(mult_block3_##M1##_##M2##_specialization)(m1, m2, out, BS, &kernel); \
+    } \
+    static void PRECISION_FUNCTION(tile_mult_block3_##M1##_##M2##_##BS)(void *job, int task) { \
+        PRECISION_FUNCTION(tile_mult_block3_##M1##_##M2##_specialization)(job, task, BS); \
+    } \
+    static void PRECISION_FUNCTION(omp_mult_block3_##M1##_##M2##_##BS)( \
+        double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const matrix_kernel_t *tuned \
+    ) { \
+        assert(block_max_size == BS); \
+        KERNEL_T kernel = PRECISION_KERNEL(tuned); \
+        matrix_pool_mult_block3(m1, m2, out, BS, &kernel, PRECISION_FUNCTION(tile_mult_block3_##M1##_##M2##_##BS)); \
+    }
+
+#define DEFINE_KERNELS(M1, M2, OUT) \
+    static void PRECISION_FUNCTION(mult_block3_##M1##_##M2##_ANY)( \
+        double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const matrix_kernel_t *tuned \
+    ) { \
+        KERNEL_T kernel = PRECISION_KERNEL(tuned); \
+        PRECISION_FUNCTION(mult_block3_##M1##_##M2##_specialization)(m1, m2, out, block_max_size, &kernel); \
+    } \
+    static void PRECISION_FUNCTION(tile_mult_block3_##M1##_##M2##_ANY)(void *job, int task) { \
+        PRECISION_FUNCTION(tile_mult_block3_##M1##_##M2##_specialization)(job, task, ((tiles_job_t *) job)->block_max_size); \
+    } \
+    static void PRECISION_FUNCTION(omp_mult_block3_##M1##_##M2##_ANY)( \
+        double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const matrix_kernel_t *tuned \
+    ) { \
+        KERNEL_T kernel = PRECISION_KERNEL(tuned); \
+        matrix_pool_mult_block3(m1, m2, out, block_max_size, &kernel, PRECISION_FUNCTION(tile_mult_block3_##M1##_##M2##_ANY)); \
+    } \
+    SPECIALIZED_BLOCK_SIZES(DEFINE_SIZED_KERNELS, M1, M2, OUT)
+
+#define PRECISION_PREFIX matrix
+#define IN_T double
+#define OUT_T double
+#define KERNEL_T matrix_kernel_t
+#define PRECISION_KERNEL(tuned) (*(tuned))
+#define PACK(NAME) matrix_kernel_##NAME
+#define MACRO_KERNEL matrix_kernel_macro
+#define SCRATCH matrix_kernel_scratch
+#include "specializations.h"
+
+#define PRECISION_PREFIX matrix_float
+#define IN_T float
+#define OUT_T float
+#define KERNEL_T matrix_kernel_float_t
+#define PRECISION_KERNEL(tuned) matrix_kernel_float_of(tuned)
+#define PACK(NAME) matrix_kernel_float_##NAME
+#define MACRO_KERNEL matrix_kernel_float_macro
+#define SCRATCH matrix_kernel_float_scratch
+#include "specializations.h"
+
+// Note: float panels are widened to double while packing, so micro-kernels and out are double
+#define PRECISION_PREFIX matrix_mixed
+#define IN_T float
+#define OUT_T double
+#define KERNEL_T matrix_kernel_t
+#define PRECISION_KERNEL(tuned) (*(tuned))
+#define PACK(NAME) matrix_kernel_mixed_##NAME
+#define MACRO_KERNEL matrix_kernel_macro
+#define SCRATCH matrix_kernel_scratch
+#include "specializations.h"
+
+// kernels[precision][parallel][m1 type][m2 type][out type][block size slot]
+static const matrix_mult_kernel_t kernels[MATRIX_PRECISIONS_COUNT][2][MATRIX_TYPES_COUNT][MATRIX_TYPES_COUNT][MATRIX_TYPES_COUNT][BLOCK_SIZES_COUNT] = {
+#define REGISTER_SIZED_KERNELS(M1, M2, OUT, BS) \
+    [0][M1][M2][OUT][BLOCK_SIZE_##BS] = PRECISION_FUNCTION(mult_block3_##M1##_##M2##_##BS), \
+    [1][M1][M2][OUT][BLOCK_SIZE_##BS] = PRECISION_FUNCTION(omp_mult_block3_##M1##_##M2##_##BS),
+#define REGISTER_KERNELS(M1, M2, OUT) \
+    [0][M1][M2][OUT][BLOCK_SIZE_ANY] = PRECISION_FUNCTION(mult_block3_##M1##_##M2##_ANY), \
+    [1][M1][M2][OUT][BLOCK_SIZE_ANY] = PRECISION_FUNCTION(omp_mult_block3_##M1##_##M2##_ANY), \
+    SPECIALIZED_BLOCK_SIZES(REGISTER_SIZED_KERNELS, M1, M2, OUT)
+#define PRECISION_PREFIX matrix
+    [MATRIX_PRECISION_DOUBLE] = { SPECIALIZED_TYPES(REGISTER_KERNELS) },
+#undef PRECISION_PREFIX
+#define PRECISION_PREFIX matrix_float
+    [MATRIX_PRECISION_FLOAT] = { SPECIALIZED_TYPES(REGISTER_KERNELS) },
+#undef PRECISION_PREFIX
+#define PRECISION_PREFIX matrix_mixed
+    [MATRIX_PRECISION_MIXED] = { SPECIALIZED_TYPES(REGISTER_KERNELS) },
+#undef PRECISION_PREFIX
+#undef REGISTER_KERNELS
+#undef REGISTER_SIZED_KERNELS
+};
+
+// Returns NULL if there is no specialization for such types.
+// Note: kernels write rows of out, so column-major out has none
+static matrix_mult_kernel_t kernel_lookup(
+    matrix_precision_t precision, int parallel, double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size
+) {
+    if (out.type == NORMAL && out.minfo.normal_info.column_major) return NULL;
+    const matrix_mult_kernel_t *sized = kernels[precision][parallel][m1.type][m2.type][out.type];
+    matrix_mult_kernel_t kernel = sized[block_size_slot(block_max_size)];
+    return kernel ? kernel : sized[BLOCK_SIZE_ANY];
+}
+
+// Product of NORMAL matrices with column-major out is computed as out^T = m2^T * m1^T,
+// transposed views are only read in other order, nothing is copied
+static void transpose_column_major_product(double_matrix_t *m1, double_matrix_t *m2, double_matrix_t *out) {
+    if (out->type != NORMAL || !out->minfo.normal_info.column_major || m1->type != NORMAL || m2->type != NORMAL)
+        return;
+    double_matrix_t m2_transposed = matrix_transposed_view(*m1);
+    *m1 = matrix_transposed_view(*m2);
+    *m2 = m2_transposed;
+    *out = matrix_transposed_view(*out);
+}
+
+int matrix_mult_block3_specialized(
+    matrix_precision_t precision, int parallel, double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size,
+    const matrix_kernel_t *tuned
+) {
+    transpose_column_major_product(&m1, &m2, &out);
+    matrix_mult_kernel_t kernel = kernel_lookup(precision, parallel, m1, m2, out, block_max_size);
+    if (!kernel) return 0;
+    matrix_kernel_t from_cache;
+    if (!tuned) {
+        from_cache = matrix_tuning_kernel(m1.type, m2.type, parallel, m1.nrows);
+        tuned = &from_cache;
+    }
+    kernel(m1, m2, out, block_max_size, tuned);
+    return 1;
 }
 
 void matrix_mult_block3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size) {
     assert(out.nrows == m1.nrows && out.ncols == m2.ncols && m1.ncols == m2.nrows);
-    // Note: for now tested only square matrices, not squared multiplication
-    // might fail
-    assert(m1.ncols == m1.nrows && m2.ncols == m2.nrows);
-    
-    // FIXME rewrite with X macro
-    if (m1.type == UPPER_TRIANGULAR_COLS && m2.type == NORMAL) {
-        matrix_mult_block3_UPPER_TRIANGULAR_COLS_NORMAL_specialization(m1, m2, out, block_max_size);
-    } else if (m1.type == UPPER_TRIANGULAR_BLOCKED && m2.type == NORMAL_BLOCKED && out.type == NORMAL_BLOCKED) {
-        matrix_mult_block3_UPPER_TRIANGULAR_BLOCKED_NORMAL_BLOCKED_specialization(m1, m2, out, block_max_size);
-    } else {
+    MATRIX_TRACE_BEGIN(span, "mult_block3");
+    if (!matrix_mult_block3_specialized(MATRIX_PRECISION_DOUBLE, 0, m1, m2, out, block_max_size, NULL)) {
         fprintf(stderr, "Unknown specializtion for matrices of given types\n");
         matrix_mult_block3_no_specialization(m1, m2, out, block_max_size);
     }
+    MATRIX_TRACE_END(span);
 }
 
 void matrix_omp_mult_block3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size) {
     assert(out.nrows == m1.nrows && out.ncols == m2.ncols && m1.ncols == m2.nrows);
-    // Note: for now tested only square matrices, not squared multiplication
-    // might fail
-    assert(m1.ncols == m1.nrows && m2.ncols == m2.nrows);
-    
-    // FIXME rewrite with X macro
-    if (m1.type == UPPER_TRIANGULAR_COLS && m2.type == NORMAL) {
-        matrix_omp_mult_block3_UPPER_TRIANGULAR_COLS_NORMAL_specialization(m1, m2, out, block_max_size);
-    } else {
-        fprintf(stderr, "Unknown how to multiply matrices of given types\n");
-        exit(1);
+    MATRIX_TRACE_BEGIN(span, "omp_mult_block3");
+    if (!matrix_mult_block3_specialized(MATRIX_PRECISION_DOUBLE, 1, m1, m2, out, block_max_size, NULL)) {
+        fprintf(stderr, "Unknown specializtion for matrices of given types\n");
+        matrix_omp_mult_block3_no_specialization(m1, m2, out, block_max_size);
+    }
+    MATRIX_TRACE_END(span);
+}
+
+typedef struct {
+    int index;
+    double flops;
+} batch_item_t;
+
+static int batch_item_compare(const void *a, const void *b) {
+    double diff = ((const batch_item_t *) b)->flops - ((const batch_item_t *) a)->flops;
+    return (diff > 0) - (diff < 0);
+}
+
+// Counts multiplication and addition as separate operations.
+// Note: with sparse operand only pairs of stored blocks are multiplied, padding of edge blocks included
+double matrix_mult_flops(double_matrix_t m1, double_matrix_t m2) {
+    if (m1.type == SPARSE_BLOCKED || m2.type == SPARSE_BLOCKED) {
+        int block_size = m1.minfo.blocked_info.block_size;
+        double pairs = 0;
+        for (int block_i = 0; block_i < matrix_blocks(m1.nrows, block_size); block_i++) {
+            int a_start, a_end;
+            block_row_entries(m1, m1.type, block_i, 0, matrix_blocks(m1.ncols, block_size), &a_start, &a_end);
+            for (int a_entry = a_start; a_entry < a_end; a_entry++) {
+                int b_start, b_end;
+                block_row_entries(
+                    m2, m2.type, block_entry_col(m1, m1.type, a_entry), 0, matrix_blocks(m2.ncols, block_size), &b_start, &b_end
+                );
+                pairs += b_end - b_start;
+            }
+        }
+        return 2.0 * pairs * block_size * block_size * block_size;
     }
+    if (is_upper_triangular(m1.type) && is_upper_triangular(m2.type)) {
+        // Note: (i, k, j) with i <= k <= j
+        double n = m1.nrows;
+        return 2.0 * n * (n + 1) * (n + 2) / 6;
+    }
+    if (is_upper_triangular(m1.type))
+        return 2.0 * m2.ncols * matrix_kernel_upper_triangular_rows_cost(0, m1.nrows, m1.ncols);
+    if (is_upper_triangular(m2.type))
+        return 2.0 * m1.nrows * matrix_kernel_upper_triangular_rows_cost(0, m2.nrows, m2.ncols);
+    return 2.0 * m1.nrows * m1.ncols * m2.ncols;
+}
+
+matrix_batch_stats_t matrix_mult_batch(
+    const double_matrix_t *m1, const double_matrix_t *m2, double_matrix_t *out, int count, int block_max_size
+) {
+    matrix_batch_stats_t stats = { 0 };
+    if (count <= 0) return stats;
+
+    batch_item_t *items = malloc(sizeof(batch_item_t) * count);
+    matrix_mult_kernel_t *batch_kernels = malloc(sizeof(matrix_mult_kernel_t) * count);
+    matrix_kernel_t *tuned = malloc(sizeof(matrix_kernel_t) * count);
+    int *block_sizes = malloc(sizeof(int) * count);
+    int unknown_specialization = 0;
+    for (int i = 0; i < count; i++) {
+        assert(out[i].nrows == m1[i].nrows && out[i].ncols == m2[i].ncols && m1[i].ncols == m2[i].nrows);
+        // Note: blocked matrices could be multiplied only with their own block size
+        if (m1[i].type == NORMAL_BLOCKED || m1[i].type == UPPER_TRIANGULAR_BLOCKED || m1[i].type == SPARSE_BLOCKED)
+            block_sizes[i] = m1[i].minfo.blocked_info.block_size;
+        else
+            block_sizes[i] = MIN(block_max_size, m1[i].nrows);
+        batch_kernels[i] = kernel_lookup(MATRIX_PRECISION_DOUBLE, 0, m1[i], m2[i], out[i], block_sizes[i]);
+        // Note: products might have different types and dimensions, each uses its own tuning
+        tuned[i] = matrix_tuning_kernel(m1[i].type, m2[i].type, 0, m1[i].nrows);
+        unknown_specialization |= batch_kernels[i] == NULL;
+        items[i] = (batch_item_t) { .index = i, .flops = matrix_mult_flops(m1[i], m2[i]) };
+        stats.flops += items[i].flops;
+    }
+    if (unknown_specialization)
+        fprintf(stderr, "Unknown specializtion for matrices of given types\n");
+
+    // Note: the largest products go first, so dynamic schedule has the smallest ones
+    // to even out threads in the end
+    qsort(items, count, sizeof(batch_item_t), batch_item_compare);
+
+    double start = omp_get_wtime();
+    #pragma omp parallel for schedule(dynamic)
+    for (int item = 0; item < count; item++) {
+        int i = items[item].index;
+        MATRIX_TRACE_BEGIN(span, "batch_product");
+        if (batch_kernels[i])
+            batch_kernels[i](m1[i], m2[i], out[i], block_sizes[i], &tuned[i]);
+        else
+            matrix_mult_block3_no_specialization(m1[i], m2[i], out[i], block_sizes[i]);
+        MATRIX_TRACE_END(span);
+    }
+    stats.seconds = omp_get_wtime() - start;
+    stats.gflops = stats.flops / stats.seconds / 1e9;
+
+    free(items);
+    free(batch_kernels);
+    free(tuned);
+    free(block_sizes);
+    return stats;
 }
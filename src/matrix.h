@@ -1,27 +1,56 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
 #include <omp.h>
 
+#define MIN(x, y) ((x < y) ? (x) : (y))
+#define MAX(x, y) ((x < y) ? (y) : (x))
+
 // Note: fro blocked types, each block in matrix is simply
 // NORMAL matrix, and normal matrix in this library is plain
 // array with columns of matrix
+// UPPER_TRIANGULAR_BLOCKED stores only nb * (nb + 1) / 2 non-zero blocks
+// one after another by block columns: (0, 0), (0, 1), (1, 1), (0, 2), ...
+// Dimensions need not be divisible by block size: edge blocks are padded with
+// zeroes to full size, so kernels always multiply whole blocks.
+// NORMAL_BLOCKED might be rectangular, other blocked and triangular types are square
+// SPARSE_BLOCKED stores only its non-zero blocks, in order of block rows, and block CSR
+// index of them after the blocks in the same allocation. Blocks which are not stored
+// are zero and none of their elements is present in matrix
 typedef enum {
     NORMAL,
     UPPER_TRIANGULAR_COLS,
     NORMAL_BLOCKED,
-    UPPER_TRIANGULAR_BLOCKED
+    UPPER_TRIANGULAR_BLOCKED,
+    SPARSE_BLOCKED
 } matrix_type_t;
 
 typedef struct {
     int block_size;
     int blocks_in_row;
+    // SPARSE_BLOCKED only: stored blocks of block row i have block columns block_cols[row_starts[i]],
+    // ..., block_cols[row_starts[i + 1] - 1] in increasing order, block of entry e is e-th in data
+    const int *row_starts;
+    const int *block_cols;
 } matrix_type_info_blocked_t;
 
+// NORMAL matrices allocated by library are contiguous row-major arrays and have zeroed info.
+// Views of other memory (see matrix_view) have element (i, j) at
+// data[i * leading_dimension + j], or at data[i + j * leading_dimension] if column_major
+typedef struct {
+    int leading_dimension;
+    int column_major;
+} matrix_type_info_normal_t;
+
 typedef union {
-    matrix_type_info_blocked_t blocked_info; // for NORMAL_BLOCKED and UPPER_TRIANGULAR_BLOCKED
+    matrix_type_info_blocked_t blocked_info; // for NORMAL_BLOCKED, UPPER_TRIANGULAR_BLOCKED and SPARSE_BLOCKED
+    matrix_type_info_normal_t normal_info; // for NORMAL
 } matrix_type_info_t;
 
 typedef struct {
@@ -32,12 +61,50 @@ typedef struct {
     void *data;
 } double_matrix_t;
 
+static inline int matrix_is_view(double_matrix_t matrix) {
+    return matrix.type == NORMAL && matrix.minfo.normal_info.leading_dimension != 0;
+}
+
+// Element (i, j) of NORMAL matrix is data[i * row_stride + j * col_stride]
+static inline void matrix_normal_strides(double_matrix_t matrix, int *row_stride, int *col_stride) {
+    matrix_type_info_normal_t info = matrix.minfo.normal_info;
+    if (!info.leading_dimension) {
+        *row_stride = matrix.ncols;
+        *col_stride = 1;
+    } else {
+        *row_stride = info.column_major ? 1 : info.leading_dimension;
+        *col_stride = info.column_major ? info.leading_dimension : 1;
+    }
+}
+
+static inline size_t matrix_normal_offset(double_matrix_t matrix, int i, int j) {
+    int row_stride, col_stride;
+    matrix_normal_strides(matrix, &row_stride, &col_stride);
+    return (size_t) i * row_stride + (size_t) j * col_stride;
+}
+
+// Returns entry of index of SPARSE_BLOCKED matrix with block (block_i, block_j), or -1 if it is not stored
+static inline int matrix_sparse_entry(double_matrix_t matrix, int block_i, int block_j) {
+    const int *cols = matrix.minfo.blocked_info.block_cols;
+    int low = matrix.minfo.blocked_info.row_starts[block_i], high = matrix.minfo.blocked_info.row_starts[block_i + 1];
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (cols[middle] < block_j) low = middle + 1;
+        else high = middle;
+    }
+    return low < matrix.minfo.blocked_info.row_starts[block_i + 1] && cols[low] == block_j ? low : -1;
+}
+
 static inline int matrix_index_in_matrix(double_matrix_t matrix, int i, int j) {
     if (i >= matrix.nrows || i < 0) return 0;
     if (j >= matrix.ncols || j < 0) return 0;
 
     if (matrix.type == NORMAL || matrix.type == NORMAL_BLOCKED) return 1;
     if ((matrix.type == UPPER_TRIANGULAR_COLS || matrix.type == UPPER_TRIANGULAR_BLOCKED) && i <= j) return 1;
+    if (matrix.type == SPARSE_BLOCKED) {
+        int block_size = matrix.minfo.blocked_info.block_size;
+        return matrix_sparse_entry(matrix, i / block_size, j / block_size) >= 0;
+    }
 
     return 0;
 }
@@ -51,26 +118,39 @@ static inline double matrix_get_UPPER_TRIANGULAR(double_matrix_t matrix, int i,
 // TODO unify with matrix_get
 static inline double matrix_get_NORMAL(double_matrix_t matrix, int i, int j) {
     double *plain = (double *) matrix.data;
-    return plain[i * matrix.ncols + j];
+    return plain[matrix_normal_offset(matrix, i, j)];
 }
 
 // TODO unify with matrix_set
 static inline double matrix_add_NORMAL(double_matrix_t matrix, int i, int j, double val) {
     double *plain = (double *) matrix.data;
     #pragma omp atomic
-    plain[i * matrix.ncols + j] += val;
+    plain[matrix_normal_offset(matrix, i, j)] += val;
+}
+
+// Returns index of block (block_i, block_j) in data of blocked matrix
+static inline size_t matrix_blocked_block_index(double_matrix_t matrix, int block_i, int block_j) {
+    if (matrix.type == UPPER_TRIANGULAR_BLOCKED) {
+        assert(block_i <= block_j && "block under diagonal is not stored");
+        return (size_t) block_j * (block_j + 1) / 2 + block_i;
+    }
+    if (matrix.type == SPARSE_BLOCKED) {
+        int entry = matrix_sparse_entry(matrix, block_i, block_j);
+        assert(entry >= 0 && "zero block is not stored");
+        return entry;
+    }
+    return (size_t) block_i * matrix.minfo.blocked_info.blocks_in_row + block_j;
 }
 
 // Retunrs subblock corresponding to given indices
 static inline double_matrix_t matrix_blocked_subblock(double_matrix_t matrix, int i, int j) {
-    assert(matrix.type == UPPER_TRIANGULAR_BLOCKED || matrix.type == NORMAL_BLOCKED);
+    assert(matrix.type == UPPER_TRIANGULAR_BLOCKED || matrix.type == NORMAL_BLOCKED || matrix.type == SPARSE_BLOCKED);
 
     double *plain = (double *) matrix.data;
     int block_size = matrix.minfo.blocked_info.block_size;
-    int blocks_in_row = matrix.minfo.blocked_info.blocks_in_row;
     int block_i = i / block_size;
     int block_j = j / block_size;
-    double *plain_block = plain + (block_i * blocks_in_row + block_j) * (block_size * block_size);
+    double *plain_block = plain + matrix_blocked_block_index(matrix, block_i, block_j) * (block_size * block_size);
     return (double_matrix_t) {
         .type = NORMAL,
         .ncols = block_size,
@@ -87,11 +167,12 @@ static inline double matrix_get(double_matrix_t matrix, int i, int j) {
     switch (matrix.type)
     {
     case NORMAL:
-        return plain[i * matrix.ncols + j];
+        return plain[matrix_normal_offset(matrix, i, j)];
     case UPPER_TRIANGULAR_COLS:
         return plain[j * (j + 1) / 2 + i];
     case UPPER_TRIANGULAR_BLOCKED:
-    case NORMAL_BLOCKED: {
+    case NORMAL_BLOCKED:
+    case SPARSE_BLOCKED: {
         int block_size = matrix.minfo.blocked_info.block_size;
         return matrix_get(
             matrix_blocked_subblock(matrix, i, j),
@@ -118,13 +199,14 @@ static inline void matrix_set(double_matrix_t matrix, int i, int j, double value
     switch (matrix.type)
     {
     case NORMAL:
-        plain[i * matrix.ncols + j] = value;
+        plain[matrix_normal_offset(matrix, i, j)] = value;
         return;
     case UPPER_TRIANGULAR_COLS:
         plain[j * (j + 1) / 2 + i] = value;
         return;
     case UPPER_TRIANGULAR_BLOCKED:
-    case NORMAL_BLOCKED: {
+    case NORMAL_BLOCKED:
+    case SPARSE_BLOCKED: {
         int block_size = matrix.minfo.blocked_info.block_size;
         matrix_set(
             matrix_blocked_subblock(matrix, i, j),
@@ -139,74 +221,155 @@ static inline void matrix_set(double_matrix_t matrix, int i, int j, double value
     }
 }
 
+// Data of matrices is allocated with matrix_alloc_data: zeroed and aligned to MATRIX_ALIGNMENT.
+// Allocations of at least 2 MiB are mapped aligned to huge pages and prefaulted by all threads,
+// huge pages are set by $MATRIX_HUGE_PAGES: transparent (default), explicit (MAP_HUGETLB) or off
+#define MATRIX_ALIGNMENT 64
+#define MATRIX_HUGE_PAGES_ENV "MATRIX_HUGE_PAGES"
+void *matrix_alloc_data(size_t size);
+void matrix_free_data(void *data);
+
+// Arena is one prefaulted mapping, allocations of thread which uses arena are taken from it
+// (every one takes its size rounded to MATRIX_ALIGNMENT plus MATRIX_ALIGNMENT bytes), so
+// repeated allocations of outputs do not call allocator or fault pages. Memory is released
+// for all allocations at once by matrix_arena_reset, matrix_free does nothing for them.
+// Allocations which do not fit are taken from heap
+typedef struct matrix_arena matrix_arena_t;
+matrix_arena_t *matrix_arena_create(size_t size);
+void matrix_arena_destroy(matrix_arena_t *arena);
+void matrix_arena_reset(matrix_arena_t *arena);
+// Makes calling thread allocate from arena (or from heap if NULL), returns previously used one
+matrix_arena_t *matrix_arena_use(matrix_arena_t *arena);
+
+// Number of blocks covering dims, the last one might be padded
+static inline int matrix_blocks(int dims, int block_size) {
+    return (dims + block_size - 1) / block_size;
+}
+
+// Number of elements stored in data of matrix of given type, with padding of edge blocks
+static inline size_t matrix_storage_size(matrix_type_t type, int nrows, int ncols, int block_size) {
+    switch (type) {
+    case NORMAL:
+        return (size_t) nrows * ncols;
+    case NORMAL_BLOCKED:
+        return (size_t) matrix_blocks(nrows, block_size) * matrix_blocks(ncols, block_size) * block_size * block_size;
+    case UPPER_TRIANGULAR_COLS:
+        return (size_t) nrows * (nrows + 1) / 2;
+    case UPPER_TRIANGULAR_BLOCKED:
+        return (size_t) matrix_blocks(nrows, block_size) * (matrix_blocks(nrows, block_size) + 1) / 2 * block_size * block_size;
+    case SPARSE_BLOCKED:
+        assert(0 && "size of SPARSE_BLOCKED depends on its index, see matrix_sparse_blocks");
+        return 0;
+    default:
+        assert(0 && "unsupported");
+        return 0;
+    }
+}
+
 static inline double_matrix_t matrix_allocate(int nrows, int ncols) {
     assert(ncols > 0 && nrows > 0);
     return (double_matrix_t) {
         .type = NORMAL,
         .ncols = ncols,
         .nrows = nrows,
-        .data = calloc(1, sizeof(double) * ncols * nrows)
+        .data = matrix_alloc_data(sizeof(double) * ncols * nrows)
     };
 }
 
-static inline double_matrix_t matrix_allocate_blocked(int dims, int block_size) {
-    assert(dims > 0);
-    assert(dims % block_size == 0 && "could not divide matrix on such blocks");
+static inline double_matrix_t matrix_allocate_blocked_rectangular(int nrows, int ncols, int block_size) {
+    assert(nrows > 0 && ncols > 0 && block_size > 0);
     return (double_matrix_t) {
         .type = NORMAL_BLOCKED,
         .minfo = (matrix_type_info_t) {
             (matrix_type_info_blocked_t) {
                 .block_size = block_size,
-                .blocks_in_row = dims / block_size
+                .blocks_in_row = matrix_blocks(ncols, block_size)
             }
         },
-        .ncols = dims,
-        .nrows = dims,
-        .data = calloc(1, sizeof(double) * dims * dims)
+        .ncols = ncols,
+        .nrows = nrows,
+        .data = matrix_alloc_data(sizeof(double) * matrix_storage_size(NORMAL_BLOCKED, nrows, ncols, block_size))
     };
 }
 
+static inline double_matrix_t matrix_allocate_blocked(int dims, int block_size) {
+    return matrix_allocate_blocked_rectangular(dims, dims, block_size);
+}
+
 static inline double_matrix_t matrix_allocate_upper_triangular_cols(int dims) {
     assert(dims > 0);
     return (double_matrix_t) {
         .type = UPPER_TRIANGULAR_COLS,
         .ncols = dims,
         .nrows = dims,
-        .data = calloc(1, (sizeof(double) / 2) * (1 + dims) * dims)
+        .data = matrix_alloc_data((sizeof(double) / 2) * (1 + dims) * dims)
     };
 }
 
 static inline double_matrix_t matrix_allocate_upper_triangular_blocked(int dims, int block_size) {
-    assert(dims > 0);
+    assert(dims > 0 && block_size > 0);
     return (double_matrix_t) {
         .type = UPPER_TRIANGULAR_BLOCKED,
         .minfo = (matrix_type_info_t) { 
             (matrix_type_info_blocked_t) {
                 .block_size = block_size,
-                .blocks_in_row = dims / block_size
+                .blocks_in_row = matrix_blocks(dims, block_size)
             }
         },
         .ncols = dims,
         .nrows = dims,
-        // Note: we can use less memory because very much blocks will be zeroed, but for
-        // tests its okay
-        .data = calloc(1, sizeof(double) * dims * dims)
+        .data = matrix_alloc_data(sizeof(double) * matrix_storage_size(UPPER_TRIANGULAR_BLOCKED, dims, dims, block_size))
     };
 }
 
-static inline void matrix_free(double_matrix_t matrix) {
-    free(matrix.data);
+// Non-owning NORMAL view of caller's memory, nothing is copied. Leading dimension is distance
+// between starts of rows (or of columns if column_major), at least ncols (nrows)
+static inline double_matrix_t matrix_view(double *data, int nrows, int ncols, int leading_dimension, int column_major) {
+    assert(nrows > 0 && ncols > 0 && data);
+    assert(leading_dimension >= (column_major ? nrows : ncols));
+    return (double_matrix_t) {
+        .type = NORMAL,
+        .minfo.normal_info = {
+            .leading_dimension = leading_dimension,
+            .column_major = column_major
+        },
+        .ncols = ncols,
+        .nrows = nrows,
+        .data = data
+    };
 }
 
-static void matrix_convert(double_matrix_t m, double_matrix_t out) {
-    assert(m.nrows == m.ncols && "only square matrices supported");
-    for (int i = 0; i < m.nrows; i++)
-        for (int j = 0; j < m.nrows; j++) {
-            if (matrix_index_in_matrix(m, i, j) && matrix_index_in_matrix(out, i, j))
-                matrix_set(out, i, j, matrix_get(m, i, j));
-        }
+// View of nrows x ncols submatrix of NORMAL matrix (or view) starting at (i, j)
+static inline double_matrix_t matrix_subview(double_matrix_t matrix, int i, int j, int nrows, int ncols) {
+    assert(matrix.type == NORMAL);
+    assert(i >= 0 && j >= 0 && i + nrows <= matrix.nrows && j + ncols <= matrix.ncols);
+    matrix_type_info_normal_t info = matrix.minfo.normal_info;
+    return matrix_view(
+        (double *) matrix.data + matrix_normal_offset(matrix, i, j), nrows, ncols,
+        info.leading_dimension ? info.leading_dimension : matrix.ncols, info.column_major
+    );
+}
+
+// View of transposed NORMAL matrix (or view): row-major memory read as column-major and vice versa
+static inline double_matrix_t matrix_transposed_view(double_matrix_t matrix) {
+    assert(matrix.type == NORMAL);
+    matrix_type_info_normal_t info = matrix.minfo.normal_info;
+    return matrix_view(
+        matrix.data, matrix.ncols, matrix.nrows,
+        info.leading_dimension ? info.leading_dimension : matrix.ncols, !info.column_major
+    );
 }
 
+// Note: memory of views belongs to caller, so they are not freed
+static inline void matrix_free(double_matrix_t matrix) {
+    if (matrix_is_view(matrix)) return;
+    matrix_free_data(matrix.data);
+}
+
+// Copies all elements of m, which are present in out. Each pair of types has
+// its own tiled converter, tiles are copied in parallel
+void matrix_convert(double_matrix_t m, double_matrix_t out);
+
 static double_matrix_t matrix_convert_to_normal(double_matrix_t m) {
     double_matrix_t out = matrix_allocate(m.nrows, m.ncols);
     matrix_convert(m, out);
@@ -221,8 +384,7 @@ static double_matrix_t matrix_convert_to_upper_triangular_cols(double_matrix_t m
 }
 
 static double_matrix_t matrix_convert_to_normal_blocked(double_matrix_t m, int block_size) {
-    assert(m.nrows == m.ncols && "supported only for squared matrices");
-    double_matrix_t out = matrix_allocate_blocked(m.nrows, block_size);
+    double_matrix_t out = matrix_allocate_blocked_rectangular(m.nrows, m.ncols, block_size);
     matrix_convert(m, out);
     return out;
 }
@@ -234,11 +396,150 @@ static double_matrix_t matrix_convert_to_upper_triangular_blocked(double_matrix_
     return out;
 }
 
-void matrix_fill_random(double_matrix_t matrix);
+// Allocates zeroed SPARSE_BLOCKED matrix, which stores block (i, j) when occupied[i * blocks_in_row + j]
+// is not zero, blocks_in_row is matrix_blocks(ncols, block_size). Index is built once here
+double_matrix_t matrix_allocate_sparse_blocked(int nrows, int ncols, int block_size, const char *occupied);
+
+// Number of blocks stored in SPARSE_BLOCKED matrix
+static inline int matrix_sparse_blocks(double_matrix_t matrix) {
+    return matrix.minfo.blocked_info.row_starts[matrix_blocks(matrix.nrows, matrix.minfo.blocked_info.block_size)];
+}
+
+// Stores only blocks of m with at least one non-zero element
+double_matrix_t matrix_convert_to_sparse_blocked(double_matrix_t m, int block_size);
+
+// Fills matrix in parallel with values uniform in [-10, 10). Element (i, j) depends only on seed,
+// stream and (i, j), so matrix is the same for any number of threads and any type. Matrices filled
+// with the same seed should use different streams
+void matrix_fill_random(double_matrix_t matrix, uint64_t seed, uint64_t stream);
+// Element (i, j) of matrix filled by matrix_fill_random with seed and stream
+double matrix_random_value(uint64_t seed, uint64_t stream, int i, int j);
+
+// Tuned parameters of blocked multiplication for one pair of types and dimension
+typedef struct {
+    char kernel[16]; // register tile: name of micro-kernel
+    int block_size;  // L3: size of blocks (or tiles of out for non-blocked types)
+    int kc;          // L1: depth of parts of packed panels, 0 means whole panel
+    int mc;          // L2: rows of parts of packed panels, 0 means whole panel
+} matrix_tuning_t;
+
+// Tuning cache lives in file $MATRIX_TUNING_CACHE (or ~/.cache/fast_matrix_multiplication.tuning),
+// entries are keyed by CPU model and cache sizes, types, dimension and number of threads
+int matrix_tuning_lookup(matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims, matrix_tuning_t *tuning);
+void matrix_tuning_store(matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims, const matrix_tuning_t *tuning);
+// Measures multiplications of random matrices with different parameters and stores the best,
+// so following multiplications of these types use it
+matrix_tuning_t matrix_autotune(matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims);
 
 void matrix_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out);
 void matrix_mult_block3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size);
 void matrix_omp_mult_block3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size);
+// FLOP count of m1 * m2, zero part of triangular m1 is not counted
+double matrix_mult_flops(double_matrix_t m1, double_matrix_t m2);
+
+// Freivalds' check of out == m1 * m2 in O(n^2): for random +-1 vectors r compares m1 (m2 r) with
+// out r, they might differ by at most tolerance * max_i (|m1| |m2| 1)_i. Wrong out passes
+// all rounds with probability at most 2^-rounds. Uses rand(), returns 0 and prints first mismatch
+int matrix_freivalds_verify(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int rounds, double tolerance);
+// Elementwise comparison in parallel, elements match if they differ by at most max_ulps units in the
+// last place or by at most max(abs_tolerance, rel_tolerance * |expected element|). Returns 0 and prints
+// number of mismatches and the worst of them (by error relative to its allowed error) otherwise
+int matrix_compare(
+    double_matrix_t expected, double_matrix_t result, double abs_tolerance, double rel_tolerance, uint64_t max_ulps
+);
+// Simple multiplication of NORMAL matrices parallelized over rows of out, reference for matrix_compare
+void matrix_reference_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out);
+
+typedef struct {
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double gflops;  // by median time
+} matrix_bench_stats_t;
+
+// Calls run warmup times, then repetitions timed times on the same buffers,
+// reset (might be NULL) is called before every run and is not timed
+matrix_bench_stats_t matrix_bench(
+    void (*run)(void *arg), void (*reset)(void *arg), void *arg, int warmup, int repetitions, double flops
+);
+
+typedef struct {
+    double flops;   // FLOP count of whole batch, zero blocks of triangular matrices are not counted
+    double seconds;
+    double gflops;
+} matrix_batch_stats_t;
+
+// Computes out[i] += m1[i] * m2[i] for i < count, matrices might have different sizes.
+// Whole batch runs in one parallel region, products are spread between threads (the
+// largest first), each one is multiplied serially reusing packing buffers of its thread
+matrix_batch_stats_t matrix_mult_batch(
+    const double_matrix_t *m1, const double_matrix_t *m2, double_matrix_t *out, int count, int block_max_size
+);
+
+typedef struct matrix_stream matrix_stream_t;
+typedef struct matrix_stream_job matrix_stream_job_t;
+
+// Asynchronous stream of products out = m1 * m2, m1 is UPPER_TRIANGULAR_COLS or UPPER_TRIANGULAR_BLOCKED,
+// m2 and out might have any other types. Every job is converted to blocked layouts with block_size,
+// multiplied with matrix_omp_mult_block3 and converted back to out, in order of submission.
+// Conversions run in background thread on one core, so conversion of the next job and
+// of result of the previous one overlap multiplication of current one. Converted matrices of two
+// jobs are double buffered and reused while shapes of jobs stay the same
+matrix_stream_t *matrix_stream_create(int block_size);
+// All jobs of stream must be waited before
+void matrix_stream_destroy(matrix_stream_t *stream);
+// Inputs must not change and out must not be accessed until job is waited
+matrix_stream_job_t *matrix_stream_submit(matrix_stream_t *stream, double_matrix_t m1, double_matrix_t m2, double_matrix_t out);
+// Blocks until out holds product, every job must be waited exactly once, it frees handle
+void matrix_stream_wait(matrix_stream_t *stream, matrix_stream_job_t *job);
+
+// Strassen-Winograd multiplication of blocked matrices, m1 might be UPPER_TRIANGULAR_BLOCKED.
+// Recursion stops when quadrant is not bigger than cutoff (or has odd number of blocks)
+void matrix_strassen_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int cutoff);
+
+// In-place triangular multiplication b := alpha * op(a) * b, where op(a) is a or its transpose.
+// a is NORMAL with only its upper (or lower) triangle read, or UPPER_TRIANGULAR_COLS (then it is
+// upper), with unit diagonal its diagonal is not read and assumed to be ones. b is NORMAL, no
+// output is allocated: columns of b are packed in panels, which are overwritten by result
+void matrix_trmm(int lower, int transposed, int unit_diagonal, double alpha, double_matrix_t a, double_matrix_t b, int block_max_size);
+// c := alpha * a * b + beta * c for NORMAL b and c, a is NORMAL or UPPER_TRIANGULAR_COLS.
+// With beta == 0 c is overwritten (even NaN in it), with beta == 1 product is accumulated
+void matrix_gemm(double alpha, double_matrix_t a, double_matrix_t b, double beta, double_matrix_t c, int block_max_size);
+
+// Binary matrix file: page sized header with type, dimensions and block size,
+// followed by data of matrix as in memory (so blocks of blocked types are contiguous).
+// Functions return 0 and print error on failure
+int matrix_save(double_matrix_t matrix, const char *path);
+// Maps matrix file without copying, data is valid until matrix_unmap
+int matrix_map(const char *path, int writable, double_matrix_t *matrix);
+// Creates zeroed matrix file of given type and dimensions and maps it writable
+int matrix_map_create(const char *path, matrix_type_t type, int nrows, int ncols, int block_size, double_matrix_t *matrix);
+void matrix_unmap(double_matrix_t matrix);
+
+// out += m1 * m2 for mapped blocked matrices (m1 might be UPPER_TRIANGULAR_BLOCKED), which might
+// be larger than physical memory: tiles of out and panels of m1 and m2 are streamed through
+// memory_budget bytes, next panels are read ahead while current ones are multiplied
+void matrix_out_of_core_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, size_t memory_budget);
+
+typedef struct matrix_expr matrix_expr_t;
+
+// Lazy chains of products: nodes only record operands, nothing is multiplied until matrix_expr_eval.
+// Leaf wraps matrix without copying, it must stay valid until evaluation. Every node returned by
+// matrix_expr_leaf and matrix_expr_mult is released with matrix_expr_free, products hold references
+// to their operands, so subexpressions might be shared
+matrix_expr_t *matrix_expr_leaf(double_matrix_t m);
+matrix_expr_t *matrix_expr_mult(matrix_expr_t *left, matrix_expr_t *right);
+void matrix_expr_free(matrix_expr_t *expr);
+// Evaluates expression as chain of its leaves in association order with the least multiplied
+// pairs of blocks. Nodes used more than once are evaluated once, their results are factors of chains.
+// UPPER_TRIANGULAR_COLS and UPPER_TRIANGULAR_BLOCKED leaves are upper triangular, products of them
+// stay UPPER_TRIANGULAR_BLOCKED and only their non-zero blocks are computed, all other intermediates
+// are NORMAL_BLOCKED. Leaves are converted to block_size unless they already have such blocked layout.
+// Result is new UPPER_TRIANGULAR_BLOCKED or NORMAL_BLOCKED matrix
+double_matrix_t matrix_expr_eval(const matrix_expr_t *expr, int block_size);
+// FLOP count of matrix_expr_eval with the same block size, padding of edge blocks included
+double matrix_expr_cost(const matrix_expr_t *expr, int block_size);
 
 static inline double_matrix_t matrix_mult2(double_matrix_t m1, double_matrix_t m2) {
     double_matrix_t out = matrix_allocate(m1.nrows, m2.ncols);
@@ -251,3 +552,5 @@ static inline double_matrix_t matrix_mult_block2(double_matrix_t m1, double_matr
     matrix_mult_block3(m1, m2, out, block_max_size);
     return out;
 }
+
+#endif
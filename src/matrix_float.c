@@ -0,0 +1,141 @@
+#include "matrix_float.h"
+#include "kernel.h"
+#include "trace.h"
+#include <float.h>
+#include <string.h>
+
+static void assert_same_layout(double_matrix_t m, double_matrix_t out) {
+    assert(m.nrows == out.nrows && m.ncols == out.ncols);
+    assert(m.type == out.type && "precision conversion does not change layout");
+    assert(!matrix_is_view(m) && !matrix_is_view(out) && "views are not converted to other precision");
+    if (m.type == NORMAL_BLOCKED || m.type == UPPER_TRIANGULAR_BLOCKED || m.type == SPARSE_BLOCKED)
+        assert(m.minfo.blocked_info.block_size == out.minfo.blocked_info.block_size);
+    if (m.type == SPARSE_BLOCKED)
+        assert(matrix_sparse_blocks(m) == matrix_sparse_blocks(out));
+}
+
+// Number of elements stored in data of matrix, including blocks of SPARSE_BLOCKED one
+static size_t stored_elements(double_matrix_t m) {
+    int block_size = m.minfo.blocked_info.block_size;
+    if (m.type == SPARSE_BLOCKED)
+        return (size_t) matrix_sparse_blocks(m) * block_size * block_size;
+    return matrix_storage_size(m.type, m.nrows, m.ncols, block_size);
+}
+
+float_matrix_t matrix_float_allocate_like(double_matrix_t m) {
+    float_matrix_t matrix = {
+        .type = m.type,
+        .minfo = m.minfo,
+        .ncols = m.ncols,
+        .nrows = m.nrows
+    };
+    if (m.type == NORMAL) {
+        matrix.minfo.normal_info = (matrix_type_info_normal_t) { 0 };
+    } else if (m.type == SPARSE_BLOCKED) {
+        // Note: index follows blocks in the same allocation, as for double matrices
+        int blocks_in_col = matrix_blocks(m.nrows, m.minfo.blocked_info.block_size);
+        size_t index_count = blocks_in_col + 1 + matrix_sparse_blocks(m);
+        size_t blocks_size = sizeof(float) * stored_elements(m);
+        char *data = matrix_alloc_data(blocks_size + sizeof(int) * index_count);
+        int *row_starts = (int *) (data + blocks_size);
+        memcpy(row_starts, m.minfo.blocked_info.row_starts, sizeof(int) * (blocks_in_col + 1));
+        memcpy(row_starts + blocks_in_col + 1, m.minfo.blocked_info.block_cols, sizeof(int) * matrix_sparse_blocks(m));
+        matrix.minfo.blocked_info.row_starts = row_starts;
+        matrix.minfo.blocked_info.block_cols = row_starts + blocks_in_col + 1;
+        matrix.data = data;
+        return matrix;
+    }
+    matrix.data = matrix_alloc_data(sizeof(float) * stored_elements(m));
+    return matrix;
+}
+
+void matrix_float_from_double(double_matrix_t m, float_matrix_t out) {
+    assert_same_layout(m, matrix_float_layout(out));
+    size_t size = stored_elements(m);
+    const double *src = (const double *) m.data;
+    float *dst = (float *) out.data;
+
+    // Note: values too small for normal floats are flushed to zero, since
+    // denormal operands make FMA of micro-kernels many times slower
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < size; i++)
+        dst[i] = fabs(src[i]) < FLT_MIN ? 0.0f : (float) src[i];
+}
+
+void matrix_float_to_double(float_matrix_t m, double_matrix_t out) {
+    assert_same_layout(matrix_float_layout(m), out);
+    size_t size = stored_elements(out);
+    const float *src = (const float *) m.data;
+    double *dst = (double *) out.data;
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < size; i++)
+        dst[i] = src[i];
+}
+
+// Generic fallbacks, products are accumulated in precision of out
+#define DEFINE_NO_SPECIALIZATION(NAME, OUT_MATRIX_T, OUT_T, OUT_IN_MATRIX, OUT_GET, OUT_SET) \
+    static void matrix_##NAME##_omp_mult_block3_no_specialization( \
+        float_matrix_t m1, float_matrix_t m2, OUT_MATRIX_T out, int block_max_size, int parallel \
+    ) { \
+        int tiles_in_col = (out.nrows + block_max_size - 1) / block_max_size; \
+        int tiles_in_row = (out.ncols + block_max_size - 1) / block_max_size; \
+        \
+        _Pragma("omp parallel for collapse(2) schedule(dynamic) if(parallel)") \
+        for (int tile_i = 0; tile_i < tiles_in_col; tile_i++) { \
+            for (int tile_j = 0; tile_j < tiles_in_row; tile_j++) { \
+                for (int i = tile_i * block_max_size; i < MIN(out.nrows, (tile_i + 1) * block_max_size); i++) { \
+                    for (int j = tile_j * block_max_size; j < MIN(out.ncols, (tile_j + 1) * block_max_size); j++) { \
+                        if (!OUT_IN_MATRIX(out, i, j)) continue; \
+                        OUT_T val = OUT_GET(out, i, j); \
+                        for (int k = 0; k < m2.nrows; k++) \
+                            val += (OUT_T) matrix_float_get_or_zero(m1, i, k) * matrix_float_get_or_zero(m2, k, j); \
+                        OUT_SET(out, i, j, val); \
+                    } \
+                } \
+            } \
+        } \
+    }
+
+DEFINE_NO_SPECIALIZATION(float, float_matrix_t, float, matrix_float_index_in_matrix, matrix_float_get, matrix_float_set)
+DEFINE_NO_SPECIALIZATION(mixed, double_matrix_t, double, matrix_index_in_matrix, matrix_get, matrix_set)
+
+// Note: specializations are the same as of matrix_mult_block3, generated for every precision
+#define DEFINE_MULT(NAME, PRECISION, OUT_MATRIX_T, OUT_LAYOUT) \
+    static void matrix_##NAME##_mult_block3_dispatch( \
+        float_matrix_t m1, float_matrix_t m2, OUT_MATRIX_T out, int block_max_size, int parallel \
+    ) { \
+        assert(out.nrows == m1.nrows && out.ncols == m2.ncols && m1.ncols == m2.nrows); \
+        \
+        MATRIX_TRACE_BEGIN(span, #NAME "_mult_block3"); \
+        if (!matrix_mult_block3_specialized( \
+            PRECISION, parallel, matrix_float_layout(m1), matrix_float_layout(m2), OUT_LAYOUT(out), block_max_size, NULL \
+        )) { \
+            fprintf(stderr, "Unknown specializtion for matrices of given types\n"); \
+            matrix_##NAME##_omp_mult_block3_no_specialization(m1, m2, out, block_max_size, parallel); \
+        } \
+        MATRIX_TRACE_END(span); \
+    }
+
+static inline double_matrix_t double_layout(double_matrix_t matrix) {
+    return matrix;
+}
+
+DEFINE_MULT(float, MATRIX_PRECISION_FLOAT, float_matrix_t, matrix_float_layout)
+DEFINE_MULT(mixed, MATRIX_PRECISION_MIXED, double_matrix_t, double_layout)
+
+void matrix_float_mult_block3(float_matrix_t m1, float_matrix_t m2, float_matrix_t out, int block_max_size) {
+    matrix_float_mult_block3_dispatch(m1, m2, out, block_max_size, 0);
+}
+
+void matrix_float_omp_mult_block3(float_matrix_t m1, float_matrix_t m2, float_matrix_t out, int block_max_size) {
+    matrix_float_mult_block3_dispatch(m1, m2, out, block_max_size, 1);
+}
+
+void matrix_mixed_mult_block3(float_matrix_t m1, float_matrix_t m2, double_matrix_t out, int block_max_size) {
+    matrix_mixed_mult_block3_dispatch(m1, m2, out, block_max_size, 0);
+}
+
+void matrix_mixed_omp_mult_block3(float_matrix_t m1, float_matrix_t m2, double_matrix_t out, int block_max_size) {
+    matrix_mixed_mult_block3_dispatch(m1, m2, out, block_max_size, 1);
+}
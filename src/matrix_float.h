@@ -0,0 +1,125 @@
+#ifndef MATRIX_FLOAT_H
+#define MATRIX_FLOAT_H
+
+#include "matrix.h"
+
+// Single precision matrix, layouts of all types are the same as for double_matrix_t
+typedef struct {
+    matrix_type_t type;
+    matrix_type_info_t minfo;
+    int ncols;
+    int nrows;
+    void *data;
+} float_matrix_t;
+
+// Returns descriptor of layout of matrix, its data stays float. Layouts are handled by functions
+// of matrix.h on descriptors, and specialized kernels of matrix.c take them for float matrices
+static inline double_matrix_t matrix_float_layout(float_matrix_t matrix) {
+    return (double_matrix_t) {
+        .type = matrix.type,
+        .minfo = matrix.minfo,
+        .ncols = matrix.ncols,
+        .nrows = matrix.nrows,
+        .data = matrix.data
+    };
+}
+
+static inline int matrix_float_index_in_matrix(float_matrix_t matrix, int i, int j) {
+    return matrix_index_in_matrix(matrix_float_layout(matrix), i, j);
+}
+
+static inline float *matrix_float_element(float_matrix_t matrix, int i, int j) {
+    assert (matrix_float_index_in_matrix(matrix, i, j));
+    double_matrix_t layout = matrix_float_layout(matrix);
+    float *plain = (float *) matrix.data;
+
+    switch (matrix.type)
+    {
+    case NORMAL:
+        return plain + matrix_normal_offset(layout, i, j);
+    case UPPER_TRIANGULAR_COLS:
+        return plain + (size_t) j * (j + 1) / 2 + i;
+    case UPPER_TRIANGULAR_BLOCKED:
+    case NORMAL_BLOCKED:
+    case SPARSE_BLOCKED: {
+        int block_size = matrix.minfo.blocked_info.block_size;
+        size_t block_index = matrix_blocked_block_index(layout, i / block_size, j / block_size);
+        return plain + block_index * block_size * block_size + (i % block_size) * block_size + j % block_size;
+    }
+    default:
+        assert(0 && "unsupported");
+        return NULL;
+    }
+}
+
+static inline float matrix_float_get(float_matrix_t matrix, int i, int j) {
+    return *matrix_float_element(matrix, i, j);
+}
+
+static inline float matrix_float_get_or_zero(float_matrix_t matrix, int i, int j) {
+    if (!matrix_float_index_in_matrix(matrix, i, j)) return 0;
+
+    return matrix_float_get(matrix, i, j);
+}
+
+static inline void matrix_float_set(float_matrix_t matrix, int i, int j, float value) {
+    *matrix_float_element(matrix, i, j) = value;
+}
+
+static inline float_matrix_t matrix_float_allocate_of_type(matrix_type_t type, int dims, int block_size) {
+    assert(dims > 0);
+    float_matrix_t matrix = {
+        .type = type,
+        .ncols = dims,
+        .nrows = dims
+    };
+    if (type == NORMAL_BLOCKED || type == UPPER_TRIANGULAR_BLOCKED) {
+        assert(block_size > 0);
+        matrix.minfo.blocked_info.block_size = block_size;
+        matrix.minfo.blocked_info.blocks_in_row = matrix_blocks(dims, block_size);
+    }
+    matrix.data = matrix_alloc_data(sizeof(float) * matrix_storage_size(type, dims, dims, block_size));
+    return matrix;
+}
+
+static inline float_matrix_t matrix_float_allocate(int dims) {
+    return matrix_float_allocate_of_type(NORMAL, dims, 0);
+}
+
+static inline float_matrix_t matrix_float_allocate_blocked(int dims, int block_size) {
+    return matrix_float_allocate_of_type(NORMAL_BLOCKED, dims, block_size);
+}
+
+static inline float_matrix_t matrix_float_allocate_upper_triangular_cols(int dims) {
+    return matrix_float_allocate_of_type(UPPER_TRIANGULAR_COLS, dims, 0);
+}
+
+static inline float_matrix_t matrix_float_allocate_upper_triangular_blocked(int dims, int block_size) {
+    return matrix_float_allocate_of_type(UPPER_TRIANGULAR_BLOCKED, dims, block_size);
+}
+
+// Allocates zeroed float matrix with the same layout, shape and block size as m,
+// SPARSE_BLOCKED one stores the same blocks. Views are allocated as contiguous NORMAL matrices
+float_matrix_t matrix_float_allocate_like(double_matrix_t m);
+
+static inline void matrix_float_free(float_matrix_t matrix) {
+    matrix_free_data(matrix.data);
+}
+
+// Precision conversions keep the layout: m and out must have the same type and block size
+// (SPARSE_BLOCKED ones the same blocks, see matrix_float_allocate_like), layouts are changed
+// with matrix_convert in double precision
+void matrix_float_from_double(double_matrix_t m, float_matrix_t out);
+void matrix_float_to_double(float_matrix_t m, double_matrix_t out);
+
+// out += m1 * m2 in single precision. Uses the same specializations as matrix_mult_block3
+// (see specializations.h), with packed panels of floats and twice wider micro-kernels
+void matrix_float_mult_block3(float_matrix_t m1, float_matrix_t m2, float_matrix_t out, int block_max_size);
+void matrix_float_omp_mult_block3(float_matrix_t m1, float_matrix_t m2, float_matrix_t out, int block_max_size);
+
+// out += m1 * m2, where single precision m1 and m2 are widened while packing,
+// so products are accumulated in double precision by double micro-kernels
+void matrix_mixed_mult_block3(float_matrix_t m1, float_matrix_t m2, double_matrix_t out, int block_max_size);
+void matrix_mixed_omp_mult_block3(float_matrix_t m1, float_matrix_t m2, double_matrix_t out, int block_max_size);
+
+#endif
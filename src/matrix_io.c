@@ -0,0 +1,277 @@
+#include "matrix.h"
+#include "kernel.h"
+#include "trace.h"
+#include <omp.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MATRIX_FILE_MAGIC "FMMATRIX"
+#define MATRIX_FILE_VERSION 1
+// Note: payload starts on page boundary, so blocks could be mapped and advised by pages
+#define MATRIX_FILE_HEADER_SIZE 4096
+
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+// Header of matrix file, integers are in native byte order.
+// Payload is data of matrix exactly as in memory, so blocks of blocked types are contiguous
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t type;
+    int32_t nrows;
+    int32_t ncols;
+    int32_t block_size;
+} matrix_file_header_t;
+
+static size_t file_size(double_matrix_t matrix) {
+    return MATRIX_FILE_HEADER_SIZE + sizeof(double) * matrix_storage_size(
+        matrix.type, matrix.nrows, matrix.ncols, matrix.minfo.blocked_info.block_size
+    );
+}
+
+static int is_blocked(matrix_type_t type) {
+    return type == NORMAL_BLOCKED || type == UPPER_TRIANGULAR_BLOCKED;
+}
+
+static matrix_file_header_t file_header(double_matrix_t matrix) {
+    matrix_file_header_t header = {
+        .version = MATRIX_FILE_VERSION,
+        .type = matrix.type,
+        .nrows = matrix.nrows,
+        .ncols = matrix.ncols,
+        .block_size = is_blocked(matrix.type) ? matrix.minfo.blocked_info.block_size : 0
+    };
+    memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+    return header;
+}
+
+int matrix_save(double_matrix_t matrix, const char *path) {
+    // Note: file format has no place for index of sparse matrix
+    if (matrix.type == SPARSE_BLOCKED) {
+        fprintf(stderr, "Could not save SPARSE_BLOCKED matrix %s, convert it to NORMAL_BLOCKED first\n", path);
+        return 0;
+    }
+    if (matrix_is_view(matrix)
+        && (matrix.minfo.normal_info.column_major || matrix.minfo.normal_info.leading_dimension != matrix.ncols)) {
+        fprintf(stderr, "Could not save strided view %s, convert it to NORMAL first\n", path);
+        return 0;
+    }
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Could not create matrix file %s\n", path);
+        return 0;
+    }
+
+    char header[MATRIX_FILE_HEADER_SIZE] = { 0 };
+    matrix_file_header_t info = file_header(matrix);
+    memcpy(header, &info, sizeof(info));
+    size_t size = file_size(matrix) - MATRIX_FILE_HEADER_SIZE;
+    int ok = fwrite(header, sizeof(header), 1, file) == 1
+        && fwrite(matrix.data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) fprintf(stderr, "Could not write matrix file %s\n", path);
+    return ok;
+}
+
+// Maps whole file, matrix data points right after header
+static int map_file(int fd, double_matrix_t *matrix, int writable, const char *path) {
+    size_t size = file_size(*matrix);
+    void *mapping = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Could not map matrix file %s\n", path);
+        return 0;
+    }
+    matrix->data = (char *) mapping + MATRIX_FILE_HEADER_SIZE;
+    return 1;
+}
+
+int matrix_map(const char *path, int writable, double_matrix_t *matrix) {
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open matrix file %s\n", path);
+        return 0;
+    }
+
+    matrix_file_header_t header;
+    off_t length = lseek(fd, 0, SEEK_END);
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != MATRIX_FILE_VERSION || header.type > UPPER_TRIANGULAR_BLOCKED
+        || header.nrows <= 0 || header.ncols <= 0
+        || (is_blocked(header.type) && header.block_size <= 0)
+        || (header.type != NORMAL && header.type != NORMAL_BLOCKED && header.nrows != header.ncols)) {
+        fprintf(stderr, "Invalid matrix file %s\n", path);
+        close(fd);
+        return 0;
+    }
+
+    *matrix = (double_matrix_t) {
+        .type = header.type,
+        .ncols = header.ncols,
+        .nrows = header.nrows
+    };
+    if (is_blocked(header.type)) {
+        matrix->minfo.blocked_info.block_size = header.block_size;
+        matrix->minfo.blocked_info.blocks_in_row = matrix_blocks(header.ncols, header.block_size);
+    }
+    if ((size_t) length < file_size(*matrix)) {
+        fprintf(stderr, "Matrix file %s is truncated\n", path);
+        close(fd);
+        return 0;
+    }
+    return map_file(fd, matrix, writable, path);
+}
+
+int matrix_map_create(const char *path, matrix_type_t type, int nrows, int ncols, int block_size, double_matrix_t *matrix) {
+    assert(nrows > 0 && ncols > 0);
+    assert((type == NORMAL || type == NORMAL_BLOCKED || nrows == ncols) && "only NORMAL and NORMAL_BLOCKED matrices might be not square");
+    *matrix = (double_matrix_t) {
+        .type = type,
+        .ncols = ncols,
+        .nrows = nrows
+    };
+    if (is_blocked(type)) {
+        assert(block_size > 0);
+        matrix->minfo.blocked_info.block_size = block_size;
+        matrix->minfo.blocked_info.blocks_in_row = matrix_blocks(ncols, block_size);
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create matrix file %s\n", path);
+        return 0;
+    }
+
+    matrix_file_header_t header = file_header(*matrix);
+    // Note: payload is sparse until written, so file of any size is created at once
+    if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) || ftruncate(fd, file_size(*matrix)) != 0) {
+        fprintf(stderr, "Could not write matrix file %s\n", path);
+        close(fd);
+        return 0;
+    }
+    return map_file(fd, matrix, 1, path);
+}
+
+void matrix_unmap(double_matrix_t matrix) {
+    munmap((char *) matrix.data - MATRIX_FILE_HEADER_SIZE, file_size(matrix));
+}
+
+// Out-of-core multiplication: out is processed by tiles of tile x tile blocks, each one is
+// accumulated over panels of depth tile blocks. While panel is multiplied, pages of the next
+// panels of m1 and m2 are read ahead by kernel, and pages of finished panels are released,
+// so only current and next panels (and current tile of out) stay resident.
+// Note: MADV_PAGEOUT keeps content (dirty file pages are written back, anonymous are swapped),
+// unlike MADV_DONTNEED which would zero matrices allocated in memory
+
+static inline double *block_of(double_matrix_t matrix, int block_i, int block_j) {
+    int block_size = matrix.minfo.blocked_info.block_size;
+    return (double *) matrix.data + matrix_blocked_block_index(matrix, block_i, block_j) * block_size * block_size;
+}
+
+// Applies advice to stored blocks [block_i_start, block_i_end) x [block_j_start, block_j_end).
+// Note: pages are aligned outward, neighbour blocks sharing a page are only faulted in again
+static void advise_blocks(
+    double_matrix_t matrix, int block_i_start, int block_i_end, int block_j_start, int block_j_end, int advice
+) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    int block_size = matrix.minfo.blocked_info.block_size;
+    int blocks_in_row = matrix.minfo.blocked_info.blocks_in_row;
+    block_i_end = MIN(block_i_end, blocks_in_row);
+    block_j_end = MIN(block_j_end, blocks_in_row);
+    for (int block_i = block_i_start; block_i < block_i_end; block_i++)
+        for (int block_j = block_j_start; block_j < block_j_end; block_j++) {
+            if (matrix.type == UPPER_TRIANGULAR_BLOCKED && block_i > block_j) continue;
+            uintptr_t start = (uintptr_t) block_of(matrix, block_i, block_j);
+            uintptr_t end = start + sizeof(double) * block_size * block_size;
+            start = start / page_size * page_size;
+            end = (end + page_size - 1) / page_size * page_size;
+            madvise((void *) start, end - start, advice);
+        }
+}
+
+// Returns number of blocks in side of tile, so that tile of out, two panels (current and
+// read ahead) of both m1 and m2 and packed copies of current panels fit in memory budget
+static int out_of_core_tile(int block_size, int blocks_in_row, size_t memory_budget) {
+    size_t block_bytes = sizeof(double) * block_size * block_size;
+    int tile = 1;
+    while (tile < blocks_in_row && 7 * block_bytes * (tile + 1) * (tile + 1) <= memory_budget)
+        tile++;
+    return tile;
+}
+
+void matrix_out_of_core_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, size_t memory_budget) {
+    assert((m1.type == UPPER_TRIANGULAR_BLOCKED || m1.type == NORMAL_BLOCKED) && m2.type == NORMAL_BLOCKED && out.type == NORMAL_BLOCKED);
+    assert(out.nrows == m1.nrows && out.ncols == m2.ncols && m1.ncols == m2.nrows);
+    assert(m1.nrows == m1.ncols && m2.nrows == m2.ncols && "only square matrices are supported");
+    int block_size = out.minfo.blocked_info.block_size;
+    assert(m1.minfo.blocked_info.block_size == block_size && m2.minfo.blocked_info.block_size == block_size);
+
+    int triangular = m1.type == UPPER_TRIANGULAR_BLOCKED;
+    int blocks = out.minfo.blocked_info.blocks_in_row;
+    int tile = out_of_core_tile(block_size, blocks, memory_budget);
+    const matrix_kernel_t *kernel = matrix_kernel_select();
+    size_t a_block_size = matrix_kernel_packed_a_size(kernel, block_size, block_size);
+    size_t b_block_size = matrix_kernel_packed_b_size(kernel, block_size, block_size);
+    // Note: shared by all threads, only calling thread writes its scratch
+    double *a_packed = matrix_kernel_scratch(MATRIX_KERNEL_SCRATCH_A, (size_t) tile * tile * a_block_size);
+    double *b_packed = matrix_kernel_scratch(MATRIX_KERNEL_SCRATCH_B, (size_t) tile * tile * b_block_size);
+
+    for (int tile_i = 0; tile_i < blocks; tile_i += tile) {
+        for (int tile_j = 0; tile_j < blocks; tile_j += tile) {
+            // Since m1 is UPPER_TRIANGULAR panels with all k < tile_i are zeroed
+            int panel_start = triangular ? tile_i : 0;
+            advise_blocks(m1, tile_i, tile_i + tile, panel_start, panel_start + tile, MADV_WILLNEED);
+            advise_blocks(m2, panel_start, panel_start + tile, tile_j, tile_j + tile, MADV_WILLNEED);
+            for (int panel = panel_start; panel < blocks; panel += tile) {
+                MATRIX_TRACE_BEGIN(span, "out_of_core_panel");
+                advise_blocks(m1, tile_i, tile_i + tile, panel + tile, panel + 2 * tile, MADV_WILLNEED);
+                advise_blocks(m2, panel + tile, panel + 2 * tile, tile_j, tile_j + tile, MADV_WILLNEED);
+
+                // Note: blocks of m1 and m2 panels are packed once, so mapped pages are read once
+                // and packed blocks are reused by all blocks of out tile in their block row or column
+                #pragma omp parallel for collapse(2) schedule(static)
+                for (int block_k = panel; block_k < MIN(blocks, panel + tile); block_k++)
+                    for (int block_j = tile_j; block_j < MIN(blocks, tile_j + tile); block_j++)
+                        matrix_kernel_pack_b(
+                            kernel, block_size, block_size, block_of(m2, block_k, block_j), block_size, 1,
+                            b_packed + ((size_t) (block_k - panel) * tile + block_j - tile_j) * b_block_size
+                        );
+                #pragma omp parallel for collapse(2) schedule(static)
+                for (int block_i = tile_i; block_i < MIN(blocks, tile_i + tile); block_i++)
+                    for (int block_k = panel; block_k < MIN(blocks, panel + tile); block_k++)
+                        if (!triangular || block_k >= block_i)
+                            matrix_kernel_pack_a(
+                                kernel, block_size, block_size, block_of(m1, block_i, block_k), block_size, 1,
+                                a_packed + ((size_t) (block_i - tile_i) * tile + block_k - panel) * a_block_size
+                            );
+
+                // Each thread owns blocks of out, so no synchronization is needed
+                #pragma omp parallel for collapse(2) schedule(dynamic)
+                for (int block_i = tile_i; block_i < MIN(blocks, tile_i + tile); block_i++) {
+                    for (int block_j = tile_j; block_j < MIN(blocks, tile_j + tile); block_j++) {
+                        int block_k_start = triangular ? MAX(panel, block_i) : panel;
+                        for (int block_k = block_k_start; block_k < MIN(blocks, panel + tile); block_k++) {
+                            matrix_kernel_macro(
+                                kernel, block_size, block_size, block_size,
+                                a_packed + ((size_t) (block_i - tile_i) * tile + block_k - panel) * a_block_size,
+                                b_packed + ((size_t) (block_k - panel) * tile + block_j - tile_j) * b_block_size,
+                                block_of(out, block_i, block_j), block_size,
+                                triangular ? (block_i - block_k) * block_size : MATRIX_KERNEL_DENSE
+                            );
+                        }
+                    }
+                }
+
+                advise_blocks(m1, tile_i, tile_i + tile, panel, panel + tile, MADV_PAGEOUT);
+                advise_blocks(m2, panel, panel + tile, tile_j, tile_j + tile, MADV_PAGEOUT);
+                MATRIX_TRACE_END(span);
+            }
+            advise_blocks(out, tile_i, tile_i + tile, tile_j, tile_j + tile, MADV_PAGEOUT);
+        }
+    }
+}
@@ -0,0 +1,254 @@
+#define _GNU_SOURCE
+#include "pool.h"
+#include "matrix.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+// Note: idle worker checks for new job this many times before sleeping, so back to back
+// calls do not wait for wake up
+#define SPIN_ITERATIONS (1 << 16)
+// Note: spinning threads yield CPU from time to time, in case pool is oversubscribed
+#define SPINS_PER_YIELD 64
+
+// Chase-Lev deque over tasks [end - bottom, end): task at position p is end - 1 - p, so owner
+// takes tasks from bottom in increasing order and thieves take the last ones from top.
+// Tasks are only taken during job, never pushed, so deque needs no buffer
+typedef struct {
+    _Alignas(64) atomic_int top;
+    _Alignas(64) atomic_int bottom;
+    int end;
+} deque_t;
+
+typedef struct {
+    int threads;
+    // Note: set after pool is created and cleared before it is freed
+    atomic_int ready;
+    pthread_t *handles;
+    deque_t *deques;
+    matrix_pool_task_t task;
+    void *arg;
+    int shutdown;
+    atomic_uint generation;
+    atomic_int finished;
+    atomic_int sleeping;
+    atomic_int busy;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_mutex_t init_mutex;
+} pool_t;
+
+static pool_t pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .init_mutex = PTHREAD_MUTEX_INITIALIZER
+};
+static __thread int in_job = 0;
+
+static inline void relax(int spins) {
+    if (spins % SPINS_PER_YIELD == SPINS_PER_YIELD - 1)
+        sched_yield();
+    else
+        __builtin_ia32_pause();
+}
+
+// Returns task taken by owner, or -1 if deque is empty
+static int take(deque_t *deque) {
+    int bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    int task = deque->end - 1 - bottom;
+    // Note: the last task goes to whoever of owner and thieves increments top first
+    if (top > bottom || (top == bottom && !atomic_compare_exchange_strong_explicit(
+        &deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed
+    )))
+        task = -1;
+    if (top >= bottom)
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return task;
+}
+
+// Returns stolen task, -1 if deque is empty or -2 if other thread took the task first
+static int steal(deque_t *deque) {
+    int top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) return -1;
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        return -2;
+    return deque->end - 1 - top;
+}
+
+static void work(int worker) {
+    in_job = 1;
+    int task;
+    while ((task = take(&pool.deques[worker])) >= 0)
+        pool.task(pool.arg, task);
+
+    // Note: deques only shrink during job, so worker leaves once it finds all of them empty
+    for (int found = 1; found;) {
+        found = 0;
+        for (int i = 1; i < pool.threads; i++) {
+            deque_t *victim = &pool.deques[(worker + i) % pool.threads];
+            while ((task = steal(victim)) != -1) {
+                found = 1;
+                if (task >= 0) pool.task(pool.arg, task);
+            }
+        }
+    }
+    in_job = 0;
+}
+
+static void *worker_main(void *arg) {
+    int worker = (int) (intptr_t) arg;
+    unsigned seen = 0;
+    for (;;) {
+        unsigned generation;
+        int spins = 0;
+        while ((generation = atomic_load_explicit(&pool.generation, memory_order_acquire)) == seen && spins < SPIN_ITERATIONS)
+            relax(spins++);
+        if (generation == seen) {
+            pthread_mutex_lock(&pool.mutex);
+            // Note: sleeping is incremented before generation is checked, and run publishes
+            // generation before it checks sleeping, so one of them sees the other
+            atomic_fetch_add(&pool.sleeping, 1);
+            while ((generation = atomic_load(&pool.generation)) == seen)
+                pthread_cond_wait(&pool.wake, &pool.mutex);
+            atomic_fetch_sub(&pool.sleeping, 1);
+            pthread_mutex_unlock(&pool.mutex);
+        }
+        seen = generation;
+        if (pool.shutdown) return NULL;
+        work(worker);
+        atomic_fetch_add_explicit(&pool.finished, 1, memory_order_release);
+    }
+}
+
+static void publish(void) {
+    atomic_fetch_add(&pool.generation, 1);
+    if (atomic_load(&pool.sleeping) > 0) {
+        pthread_mutex_lock(&pool.mutex);
+        pthread_cond_broadcast(&pool.wake);
+        pthread_mutex_unlock(&pool.mutex);
+    }
+}
+
+// Note: waits for running job, and keeps busy set until release, so calls meanwhile run serially
+static void acquire(void) {
+    for (int spins = 0, idle = 0; !atomic_compare_exchange_strong(&pool.busy, &idle, 1); spins++, idle = 0)
+        relax(spins);
+}
+
+static void release(void) {
+    atomic_store_explicit(&pool.busy, 0, memory_order_release);
+}
+
+// Note: create and destroy are called with init_mutex held
+static void create(int threads, int pin) {
+    pool.threads = threads;
+    pool.handles = malloc(sizeof(pthread_t) * threads);
+    pool.deques = aligned_alloc(_Alignof(deque_t), sizeof(deque_t) * threads);
+    for (int worker = 0; worker < threads; worker++) {
+        atomic_init(&pool.deques[worker].top, 0);
+        atomic_init(&pool.deques[worker].bottom, 0);
+    }
+
+    cpu_set_t allowed;
+    int cpus = 0;
+    if (pin && sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        cpus = CPU_COUNT(&allowed);
+    else if (pin)
+        fprintf(stderr, "Could not get CPU affinity, pool workers are not pinned\n");
+
+    // Note: calling thread keeps its affinity, otherwise OpenMP threads created later would
+    // inherit single CPU, so its CPU is the first one of mask and workers take the next ones
+    for (int worker = 1; worker < threads; worker++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (cpus > 0) {
+            int target = worker % cpus, cpu = -1;
+            while (target >= 0)
+                if (CPU_ISSET(++cpu, &allowed)) target--;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        int error = pthread_create(&pool.handles[worker], &attr, worker_main, (void *) (intptr_t) worker);
+        assert(error == 0 && "could not create pool worker");
+        pthread_attr_destroy(&attr);
+    }
+    atomic_store_explicit(&pool.ready, 1, memory_order_release);
+}
+
+static void destroy(void) {
+    if (pool.threads == 0) return;
+    atomic_store_explicit(&pool.ready, 0, memory_order_relaxed);
+    pool.shutdown = 1;
+    publish();
+    for (int worker = 1; worker < pool.threads; worker++)
+        pthread_join(pool.handles[worker], NULL);
+    free(pool.handles);
+    free(pool.deques);
+    pool.threads = 0;
+    pool.shutdown = 0;
+    // Note: workers of the next pool start from generation 0, so they wait for its first job
+    atomic_store(&pool.generation, 0);
+}
+
+void matrix_pool_init(int threads, int pin) {
+    assert(threads > 0);
+    assert(!in_job && "pool could not be rebuilt from its own task");
+    pthread_mutex_lock(&pool.init_mutex);
+    acquire();
+    destroy();
+    create(threads, pin);
+    release();
+    pthread_mutex_unlock(&pool.init_mutex);
+}
+
+void matrix_pool_free(void) {
+    assert(!in_job && "pool could not be freed from its own task");
+    pthread_mutex_lock(&pool.init_mutex);
+    acquire();
+    destroy();
+    release();
+    pthread_mutex_unlock(&pool.init_mutex);
+}
+
+int matrix_pool_threads(void) {
+    if (!atomic_load_explicit(&pool.ready, memory_order_acquire)) {
+        pthread_mutex_lock(&pool.init_mutex);
+        if (pool.threads == 0) create(omp_get_max_threads(), 0);
+        pthread_mutex_unlock(&pool.init_mutex);
+    }
+    return pool.threads;
+}
+
+void matrix_pool_run(int count, const int *bounds, matrix_pool_task_t task, void *arg) {
+    int idle = 0;
+    if (in_job || omp_in_parallel() || matrix_pool_threads() == 1 || count <= 1
+        || !atomic_compare_exchange_strong(&pool.busy, &idle, 1)) {
+        for (int i = 0; i < count; i++)
+            task(arg, i);
+        return;
+    }
+
+    for (int worker = 0; worker < pool.threads; worker++) {
+        int start = bounds ? bounds[worker] : (int) ((long long) count * worker / pool.threads);
+        int end = bounds ? bounds[worker + 1] : (int) ((long long) count * (worker + 1) / pool.threads);
+        atomic_store_explicit(&pool.deques[worker].top, 0, memory_order_relaxed);
+        atomic_store_explicit(&pool.deques[worker].bottom, end - start, memory_order_relaxed);
+        pool.deques[worker].end = end;
+    }
+    pool.task = task;
+    pool.arg = arg;
+    atomic_store_explicit(&pool.finished, 0, memory_order_relaxed);
+    publish();
+
+    work(0);
+    for (int spins = 0; atomic_load_explicit(&pool.finished, memory_order_acquire) < pool.threads - 1; spins++)
+        relax(spins);
+    release();
+}
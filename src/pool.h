@@ -0,0 +1,29 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Persistent pool of worker threads for repeated multiplications. Workers live between calls,
+// so a call costs only waking them (they spin shortly after every job before sleeping), instead of
+// opening OpenMP parallel region. Every worker has work-stealing deque of task indices: it takes
+// its own tasks from one end in order, idle workers steal from the other end.
+// Calling thread is worker 0 and runs tasks too
+
+// Runs task(arg, index) for one index, tasks of one run might go in any order and in parallel
+typedef void (*matrix_pool_task_t)(void *arg, int task);
+
+// (Re)creates pool of threads workers (including calling thread). With pin every worker except
+// calling thread is pinned to its own CPU of process affinity mask, starting from the second one.
+// Calling thread keeps its affinity, so OpenMP threads it creates later are not restricted.
+// Both wait until job running on pool is done, runs started meanwhile run serially
+void matrix_pool_init(int threads, int pin);
+void matrix_pool_free(void);
+// Number of workers, pool is created with omp_get_max_threads() workers on first use
+// (concurrent first callers wait until it is created)
+int matrix_pool_threads(void);
+
+// Runs tasks [0, count) on pool and returns when all of them are done. Worker w starts with tasks
+// [bounds[w], bounds[w + 1]) (bounds has matrix_pool_threads() + 1 entries), or with equal
+// ranges if bounds is NULL. Nested calls, calls inside OpenMP parallel region and calls while
+// pool runs another job run all tasks serially in calling thread
+void matrix_pool_run(int count, const int *bounds, matrix_pool_task_t task, void *arg);
+
+#endif
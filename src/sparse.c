@@ -0,0 +1,63 @@
+#include "matrix.h"
+
+double_matrix_t matrix_allocate_sparse_blocked(int nrows, int ncols, int block_size, const char *occupied) {
+    assert(nrows > 0 && ncols > 0 && block_size > 0);
+    int blocks_in_col = matrix_blocks(nrows, block_size);
+    int blocks_in_row = matrix_blocks(ncols, block_size);
+    int blocks = 0;
+    for (size_t block = 0; block < (size_t) blocks_in_col * blocks_in_row; block++)
+        blocks += occupied[block] != 0;
+
+    // Note: index follows blocks in the same allocation, so matrix_free releases it too
+    size_t blocks_size = sizeof(double) * blocks * block_size * block_size;
+    char *data = matrix_alloc_data(blocks_size + sizeof(int) * (blocks_in_col + 1 + blocks));
+    int *row_starts = (int *) (data + blocks_size);
+    int *block_cols = row_starts + blocks_in_col + 1;
+    int entry = 0;
+    for (int block_i = 0; block_i < blocks_in_col; block_i++) {
+        row_starts[block_i] = entry;
+        for (int block_j = 0; block_j < blocks_in_row; block_j++)
+            if (occupied[(size_t) block_i * blocks_in_row + block_j])
+                block_cols[entry++] = block_j;
+    }
+    row_starts[blocks_in_col] = entry;
+
+    return (double_matrix_t) {
+        .type = SPARSE_BLOCKED,
+        .minfo = (matrix_type_info_t) {
+            (matrix_type_info_blocked_t) {
+                .block_size = block_size,
+                .blocks_in_row = blocks_in_row,
+                .row_starts = row_starts,
+                .block_cols = block_cols
+            }
+        },
+        .ncols = ncols,
+        .nrows = nrows,
+        .data = data
+    };
+}
+
+double_matrix_t matrix_convert_to_sparse_blocked(double_matrix_t m, int block_size) {
+    assert(block_size > 0);
+    int blocks_in_col = matrix_blocks(m.nrows, block_size);
+    int blocks_in_row = matrix_blocks(m.ncols, block_size);
+    char *occupied = calloc((size_t) blocks_in_col * blocks_in_row, 1);
+
+    // Note: every block is scanned by one thread, until its first non-zero element
+    #pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int block_i = 0; block_i < blocks_in_col; block_i++)
+        for (int block_j = 0; block_j < blocks_in_row; block_j++) {
+            int end_i = MIN(m.nrows, (block_i + 1) * block_size), end_j = MIN(m.ncols, (block_j + 1) * block_size);
+            char nonzero = 0;
+            for (int i = block_i * block_size; i < end_i && !nonzero; i++)
+                for (int j = block_j * block_size; j < end_j && !nonzero; j++)
+                    nonzero = matrix_get_or_zero(m, i, j) != 0;
+            occupied[(size_t) block_i * blocks_in_row + block_j] = nonzero;
+        }
+
+    double_matrix_t out = matrix_allocate_sparse_blocked(m.nrows, m.ncols, block_size, occupied);
+    free(occupied);
+    matrix_convert(m, out);
+    return out;
+}
@@ -0,0 +1,332 @@
+// Specializations of blocked multiplication for one precision, matrix.c includes this file once
+// per precision after defining:
+// PRECISION_PREFIX - prefix of generated functions (matrix, matrix_float or matrix_mixed),
+// they are named with PRECISION_FUNCTION
+// IN_T - elements of m1 and m2, OUT_T - elements of out and of packed panels
+// KERNEL_T - micro-kernel type, PRECISION_KERNEL(kernel) - makes it from tuned matrix_kernel_t
+// PACK(NAME) - packing functions of kernel.h, MACRO_KERNEL and SCRATCH - macro-kernel and its buffers
+// Matrices are passed as double_matrix_t descriptors of their layout (see matrix_float_layout),
+// their data is accessed only through IN_T and OUT_T pointers
+
+// Note: block_max_size is used as size of packed panels of A (block_max_size x block_max_size)
+// and B (block_max_size x out.ncols), packed panels are multiplied with SIMD micro-kernel.
+// NORMAL operands might be views with any strides, packing reads them directly, rows of out
+// must be contiguous (column-major out is multiplied transposed by matrix_mult_block3)
+static inline __attribute__((always_inline)) void PRECISION_FUNCTION(mult_block3_UPPER_TRIANGULAR_COLS_NORMAL_specialization)(
+    double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const KERNEL_T *kernel
+) {
+    assert(m1.type == UPPER_TRIANGULAR_COLS && m2.type == NORMAL && out.type == NORMAL);
+    int b_rs, b_cs, out_rs, out_cs;
+    matrix_normal_strides(m2, &b_rs, &b_cs);
+    matrix_normal_strides(out, &out_rs, &out_cs);
+    assert(out_cs == 1);
+
+    OUT_T *a_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_A, PACK(packed_a_size)(kernel, block_max_size, block_max_size));
+    OUT_T *b_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_B, PACK(packed_b_size)(kernel, block_max_size, out.ncols));
+    IN_T *b_plain = (IN_T *) m2.data;
+    OUT_T *out_plain = (OUT_T *) out.data;
+
+    for (int block_start_k = 0; block_start_k < m2.nrows; block_start_k += block_max_size) {
+        MATRIX_TRACE_BEGIN(span, "panel");
+        int kc = MIN(block_max_size, m2.nrows - block_start_k);
+        PACK(pack_b)(kernel, kc, out.ncols, b_plain + (size_t) block_start_k * b_rs, b_rs, b_cs, b_packed);
+        // Since m1 is UPPER_TRIANGULAR we can skip all blocks when block_start_i > block_start_k
+        // (they are zeroed)
+        for (int block_start_i = 0; block_start_i <= block_start_k && block_start_i < out.nrows; block_start_i += block_max_size) {
+            int mc = MIN(block_max_size, out.nrows - block_start_i);
+            PACK(pack_a_upper_triangular_cols)(kernel, (IN_T *) m1.data, block_start_i, block_start_k, mc, kc, a_packed);
+            MACRO_KERNEL(
+                kernel, mc, out.ncols, kc, a_packed, b_packed,
+                out_plain + (size_t) block_start_i * out_rs, out_rs,
+                block_start_i - block_start_k
+            );
+        }
+        MATRIX_TRACE_END(span);
+    }
+}
+
+// Same as UPPER_TRIANGULAR_COLS x NORMAL for dense m1, shapes might be arbitrary:
+// edges of panels are padded with zeroes by packing and handled by micro-kernel
+static inline __attribute__((always_inline)) void PRECISION_FUNCTION(mult_block3_NORMAL_NORMAL_specialization)(
+    double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const KERNEL_T *kernel
+) {
+    assert(m1.type == NORMAL && m2.type == NORMAL && out.type == NORMAL);
+    int a_rs, a_cs, b_rs, b_cs, out_rs, out_cs;
+    matrix_normal_strides(m1, &a_rs, &a_cs);
+    matrix_normal_strides(m2, &b_rs, &b_cs);
+    matrix_normal_strides(out, &out_rs, &out_cs);
+    assert(out_cs == 1);
+
+    OUT_T *a_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_A, PACK(packed_a_size)(kernel, block_max_size, block_max_size));
+    OUT_T *b_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_B, PACK(packed_b_size)(kernel, block_max_size, out.ncols));
+    IN_T *a_plain = (IN_T *) m1.data;
+    IN_T *b_plain = (IN_T *) m2.data;
+    OUT_T *out_plain = (OUT_T *) out.data;
+
+    for (int block_start_k = 0; block_start_k < m2.nrows; block_start_k += block_max_size) {
+        MATRIX_TRACE_BEGIN(span, "panel");
+        int kc = MIN(block_max_size, m2.nrows - block_start_k);
+        PACK(pack_b)(kernel, kc, out.ncols, b_plain + (size_t) block_start_k * b_rs, b_rs, b_cs, b_packed);
+        for (int block_start_i = 0; block_start_i < out.nrows; block_start_i += block_max_size) {
+            int mc = MIN(block_max_size, out.nrows - block_start_i);
+            PACK(pack_a)(
+                kernel, mc, kc, a_plain + (size_t) block_start_i * a_rs + (size_t) block_start_k * a_cs, a_rs, a_cs, a_packed
+            );
+            MACRO_KERNEL(
+                kernel, mc, out.ncols, kc, a_packed, b_packed,
+                out_plain + (size_t) block_start_i * out_rs, out_rs,
+                MATRIX_KERNEL_DENSE
+            );
+        }
+        MATRIX_TRACE_END(span);
+    }
+}
+
+// Note: whole block row of m2 is packed once per block_start_k, and each block of m1
+// is packed once, so every block is read from memory only once
+static inline __attribute__((always_inline)) void PRECISION_FUNCTION(mult_block3_UPPER_TRIANGULAR_BLOCKED_NORMAL_BLOCKED_specialization)(
+    double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const KERNEL_T *kernel
+) {
+    assert(m1.type == UPPER_TRIANGULAR_BLOCKED && m2.type == NORMAL_BLOCKED && out.type == NORMAL_BLOCKED);
+    assert(m1.minfo.blocked_info.block_size == block_max_size);
+    assert(m2.minfo.blocked_info.block_size == block_max_size);
+    assert(out.minfo.blocked_info.block_size == block_max_size);
+
+    size_t b_block_size = PACK(packed_b_size)(kernel, block_max_size, block_max_size);
+    OUT_T *a_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_A, PACK(packed_a_size)(kernel, block_max_size, block_max_size));
+    OUT_T *b_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_B, b_block_size * m2.minfo.blocked_info.blocks_in_row);
+
+    for (int block_start_k = 0; block_start_k < m2.nrows; block_start_k += block_max_size) {
+        MATRIX_TRACE_BEGIN(span, "panel");
+        for (int block_start_j = 0; block_start_j < out.ncols; block_start_j += block_max_size) {
+            PACK(pack_b)(
+                kernel, block_max_size, block_max_size, (IN_T *) m2.data + block_offset(m2, block_start_k, block_start_j),
+                block_max_size, 1, b_packed + (block_start_j / block_max_size) * b_block_size
+            );
+        }
+        // Since m1 is UPPER_TRIANGULAR we can skip all blocks when block_start_i > block_start_k
+        // (they are not even stored), stored blocks of this block column lie one after another
+        for (int block_start_i = 0; block_start_i <= block_start_k; block_start_i += block_max_size) {
+            PACK(pack_a)(
+                kernel, block_max_size, block_max_size, (IN_T *) m1.data + block_offset(m1, block_start_i, block_start_k),
+                block_max_size, 1, a_packed
+            );
+            for (int block_start_j = 0; block_start_j < out.ncols; block_start_j += block_max_size) {
+                MACRO_KERNEL(
+                    kernel, block_max_size, block_max_size, block_max_size, a_packed,
+                    b_packed + (block_start_j / block_max_size) * b_block_size,
+                    (OUT_T *) out.data + block_offset(out, block_start_i, block_start_j), block_max_size,
+                    block_start_i - block_start_k
+                );
+            }
+        }
+        MATRIX_TRACE_END(span);
+    }
+}
+
+static inline __attribute__((always_inline)) void PRECISION_FUNCTION(tile_mult_block3_UPPER_TRIANGULAR_COLS_NORMAL_specialization)(
+    const tiles_job_t *job, int task, int block_max_size
+) {
+    double_matrix_t m1 = job->m1, m2 = job->m2, out = job->out;
+    assert(m1.type == UPPER_TRIANGULAR_COLS && m2.type == NORMAL && out.type == NORMAL);
+    int b_rs, b_cs, out_rs, out_cs;
+    matrix_normal_strides(m2, &b_rs, &b_cs);
+    matrix_normal_strides(out, &out_rs, &out_cs);
+    assert(out_cs == 1);
+
+    const KERNEL_T *kernel = job->kernel;
+    OUT_T *a_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_A, PACK(packed_a_size)(kernel, block_max_size, block_max_size));
+    OUT_T *b_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_B, PACK(packed_b_size)(kernel, block_max_size, job->tiles_per_task * block_max_size));
+    IN_T *b_plain = (IN_T *) m2.data;
+    OUT_T *out_plain = (OUT_T *) out.data;
+    MATRIX_TRACE_BEGIN(span, "tile_row");
+
+    int tile_i, tile_j_start, tile_j_end;
+    task_tiles(job, task, &tile_i, &tile_j_start, &tile_j_end);
+    int block_start_i = tile_i * block_max_size;
+    int block_start_j = tile_j_start * block_max_size;
+    int mc = MIN(block_max_size, out.nrows - block_start_i);
+    int nc = MIN(out.ncols, tile_j_end * block_max_size) - block_start_j;
+    // Since m1 is UPPER_TRIANGULAR all k < block_start_i give zeroes
+    for (int block_start_k = block_start_i; block_start_k < m2.nrows; block_start_k += block_max_size) {
+        int kc = MIN(block_max_size, m2.nrows - block_start_k);
+        PACK(pack_a_upper_triangular_cols)(kernel, (IN_T *) m1.data, block_start_i, block_start_k, mc, kc, a_packed);
+        PACK(pack_b)(
+            kernel, kc, nc, b_plain + (size_t) block_start_k * b_rs + (size_t) block_start_j * b_cs, b_rs, b_cs, b_packed
+        );
+        MACRO_KERNEL(
+            kernel, mc, nc, kc, a_packed, b_packed,
+            out_plain + (size_t) block_start_i * out_rs + block_start_j, out_rs,
+            block_start_i - block_start_k
+        );
+    }
+    MATRIX_TRACE_END(span);
+}
+
+// Same as for UPPER_TRIANGULAR_COLS x NORMAL, but m1 is dense
+static inline __attribute__((always_inline)) void PRECISION_FUNCTION(tile_mult_block3_NORMAL_NORMAL_specialization)(
+    const tiles_job_t *job, int task, int block_max_size
+) {
+    double_matrix_t m1 = job->m1, m2 = job->m2, out = job->out;
+    assert(m1.type == NORMAL && m2.type == NORMAL && out.type == NORMAL);
+    int a_rs, a_cs, b_rs, b_cs, out_rs, out_cs;
+    matrix_normal_strides(m1, &a_rs, &a_cs);
+    matrix_normal_strides(m2, &b_rs, &b_cs);
+    matrix_normal_strides(out, &out_rs, &out_cs);
+    assert(out_cs == 1);
+
+    const KERNEL_T *kernel = job->kernel;
+    OUT_T *a_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_A, PACK(packed_a_size)(kernel, block_max_size, block_max_size));
+    OUT_T *b_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_B, PACK(packed_b_size)(kernel, block_max_size, job->tiles_per_task * block_max_size));
+    IN_T *a_plain = (IN_T *) m1.data;
+    IN_T *b_plain = (IN_T *) m2.data;
+    OUT_T *out_plain = (OUT_T *) out.data;
+    MATRIX_TRACE_BEGIN(span, "tile_row");
+
+    int tile_i, tile_j_start, tile_j_end;
+    task_tiles(job, task, &tile_i, &tile_j_start, &tile_j_end);
+    int block_start_i = tile_i * block_max_size;
+    int block_start_j = tile_j_start * block_max_size;
+    int mc = MIN(block_max_size, out.nrows - block_start_i);
+    int nc = MIN(out.ncols, tile_j_end * block_max_size) - block_start_j;
+    for (int block_start_k = 0; block_start_k < m2.nrows; block_start_k += block_max_size) {
+        int kc = MIN(block_max_size, m2.nrows - block_start_k);
+        PACK(pack_a)(
+            kernel, mc, kc, a_plain + (size_t) block_start_i * a_rs + (size_t) block_start_k * a_cs, a_rs, a_cs, a_packed
+        );
+        PACK(pack_b)(
+            kernel, kc, nc, b_plain + (size_t) block_start_k * b_rs + (size_t) block_start_j * b_cs, b_rs, b_cs, b_packed
+        );
+        MACRO_KERNEL(
+            kernel, mc, nc, kc, a_packed, b_packed,
+            out_plain + (size_t) block_start_i * out_rs + block_start_j, out_rs,
+            MATRIX_KERNEL_DENSE
+        );
+    }
+    MATRIX_TRACE_END(span);
+}
+
+// Same as for UPPER_TRIANGULAR_COLS x NORMAL, but tiles of out are simply blocks
+// of blocked matrices
+static inline __attribute__((always_inline)) void PRECISION_FUNCTION(tile_mult_block3_UPPER_TRIANGULAR_BLOCKED_NORMAL_BLOCKED_specialization)(
+    const tiles_job_t *job, int task, int block_max_size
+) {
+    double_matrix_t m1 = job->m1, m2 = job->m2, out = job->out;
+    assert(m1.type == UPPER_TRIANGULAR_BLOCKED && m2.type == NORMAL_BLOCKED && out.type == NORMAL_BLOCKED);
+    assert(m1.minfo.blocked_info.block_size == block_max_size);
+    assert(m2.minfo.blocked_info.block_size == block_max_size);
+    assert(out.minfo.blocked_info.block_size == block_max_size);
+
+    const KERNEL_T *kernel = job->kernel;
+    OUT_T *a_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_A, PACK(packed_a_size)(kernel, block_max_size, block_max_size));
+    OUT_T *b_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_B, PACK(packed_b_size)(kernel, block_max_size, block_max_size));
+    MATRIX_TRACE_BEGIN(span, "tile_row");
+
+    int tile_i, tile_j_start, tile_j_end;
+    task_tiles(job, task, &tile_i, &tile_j_start, &tile_j_end);
+    int block_start_i = tile_i * block_max_size;
+    // Since m1 is UPPER_TRIANGULAR all blocks with block_start_k < block_start_i are zeroed
+    for (int block_start_k = block_start_i; block_start_k < m2.nrows; block_start_k += block_max_size) {
+        PACK(pack_a)(
+            kernel, block_max_size, block_max_size, (IN_T *) m1.data + block_offset(m1, block_start_i, block_start_k),
+            block_max_size, 1, a_packed
+        );
+        for (int tile_j = tile_j_start; tile_j < tile_j_end; tile_j++) {
+            int block_start_j = tile_j * block_max_size;
+            PACK(pack_b)(
+                kernel, block_max_size, block_max_size, (IN_T *) m2.data + block_offset(m2, block_start_k, block_start_j),
+                block_max_size, 1, b_packed
+            );
+            MACRO_KERNEL(
+                kernel, block_max_size, block_max_size, block_max_size, a_packed, b_packed,
+                (OUT_T *) out.data + block_offset(out, block_start_i, block_start_j), block_max_size,
+                block_start_i - block_start_k
+            );
+        }
+    }
+    MATRIX_TRACE_END(span);
+}
+
+// Multiplies only pairs of stored blocks m1(i, k) x m2(k, j) for tiles (i, j) of task, so zero
+// blocks of SPARSE_BLOCKED and UPPER_TRIANGULAR_BLOCKED are skipped. Block of m1 is packed only
+// if its block row of m2 has stored blocks in segment of task. Product of two upper triangular
+// matrices is upper triangular, so out might be UPPER_TRIANGULAR_BLOCKED in that case
+static inline __attribute__((always_inline)) void PRECISION_FUNCTION(block_pairs_tile_mult)(
+    const tiles_job_t *job, int task, int block_max_size, matrix_type_t m1_type, matrix_type_t m2_type, matrix_type_t out_type
+) {
+    double_matrix_t m1 = job->m1, m2 = job->m2, out = job->out;
+    assert(m1.type == m1_type && m2.type == m2_type && out.type == out_type);
+    assert(out_type == NORMAL_BLOCKED || (m1_type == UPPER_TRIANGULAR_BLOCKED && m2_type == UPPER_TRIANGULAR_BLOCKED));
+    assert(m1.minfo.blocked_info.block_size == block_max_size);
+    assert(m2.minfo.blocked_info.block_size == block_max_size);
+    assert(out.minfo.blocked_info.block_size == block_max_size);
+
+    const KERNEL_T *kernel = job->kernel;
+    OUT_T *a_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_A, PACK(packed_a_size)(kernel, block_max_size, block_max_size));
+    OUT_T *b_packed = SCRATCH(MATRIX_KERNEL_SCRATCH_B, PACK(packed_b_size)(kernel, block_max_size, block_max_size));
+    MATRIX_TRACE_BEGIN(span, "tile_row");
+
+    int tile_i, tile_j_start, tile_j_end;
+    task_tiles(job, task, &tile_i, &tile_j_start, &tile_j_end);
+    int a_start, a_end;
+    block_row_entries(m1, m1_type, tile_i, 0, matrix_blocks(m1.ncols, block_max_size), &a_start, &a_end);
+    for (int a_entry = a_start; a_entry < a_end; a_entry++) {
+        int block_k = block_entry_col(m1, m1_type, a_entry);
+        int b_start, b_end;
+        block_row_entries(m2, m2_type, block_k, tile_j_start, tile_j_end, &b_start, &b_end);
+        if (b_start == b_end) continue;
+        PACK(pack_a)(
+            kernel, block_max_size, block_max_size, (IN_T *) m1.data + block_entry_offset(m1, m1_type, tile_i, a_entry, block_max_size),
+            block_max_size, 1, a_packed
+        );
+        for (int b_entry = b_start; b_entry < b_end; b_entry++) {
+            int block_j = block_entry_col(m2, m2_type, b_entry);
+            PACK(pack_b)(
+                kernel, block_max_size, block_max_size, (IN_T *) m2.data + block_entry_offset(m2, m2_type, block_k, b_entry, block_max_size),
+                block_max_size, 1, b_packed
+            );
+            MACRO_KERNEL(
+                kernel, block_max_size, block_max_size, block_max_size, a_packed, b_packed,
+                (OUT_T *) out.data + block_offset(out, tile_i * block_max_size, block_j * block_max_size), block_max_size,
+                m1_type == UPPER_TRIANGULAR_BLOCKED ? (tile_i - block_k) * block_max_size : MATRIX_KERNEL_DENSE
+            );
+        }
+    }
+    MATRIX_TRACE_END(span);
+}
+
+// Serial version takes whole rows of tiles, so every stored block of m1 is packed once
+#define DEFINE_BLOCK_PAIRS_SPECIALIZATION(M1, M2, OUT) \
+    static inline __attribute__((always_inline)) void PRECISION_FUNCTION(tile_mult_block3_##M1##_##M2##_specialization)( \
+        const tiles_job_t *job, int task, int block_max_size \
+    ) { \
+        PRECISION_FUNCTION(block_pairs_tile_mult)(job, task, block_max_size, M1, M2, OUT); \
+    } \
+    static inline __attribute__((always_inline)) void PRECISION_FUNCTION(mult_block3_##M1##_##M2##_specialization)( \
+        double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int block_max_size, const KERNEL_T *kernel \
+    ) { \
+        tiles_job_t job = tiles_job(m1, m2, out, block_max_size, kernel, 1); \
+        for (int task = 0; task < matrix_blocks(out.nrows, block_max_size); task++) \
+            PRECISION_FUNCTION(block_pairs_tile_mult)(&job, task, block_max_size, M1, M2, OUT); \
+    }
+
+DEFINE_BLOCK_PAIRS_SPECIALIZATION(SPARSE_BLOCKED, NORMAL_BLOCKED, NORMAL_BLOCKED)
+DEFINE_BLOCK_PAIRS_SPECIALIZATION(NORMAL_BLOCKED, SPARSE_BLOCKED, NORMAL_BLOCKED)
+DEFINE_BLOCK_PAIRS_SPECIALIZATION(SPARSE_BLOCKED, SPARSE_BLOCKED, NORMAL_BLOCKED)
+DEFINE_BLOCK_PAIRS_SPECIALIZATION(UPPER_TRIANGULAR_BLOCKED, SPARSE_BLOCKED, NORMAL_BLOCKED)
+DEFINE_BLOCK_PAIRS_SPECIALIZATION(NORMAL_BLOCKED, NORMAL_BLOCKED, NORMAL_BLOCKED)
+DEFINE_BLOCK_PAIRS_SPECIALIZATION(NORMAL_BLOCKED, UPPER_TRIANGULAR_BLOCKED, NORMAL_BLOCKED)
+DEFINE_BLOCK_PAIRS_SPECIALIZATION(UPPER_TRIANGULAR_BLOCKED, UPPER_TRIANGULAR_BLOCKED, UPPER_TRIANGULAR_BLOCKED)
+
+#undef DEFINE_BLOCK_PAIRS_SPECIALIZATION
+
+SPECIALIZED_TYPES(DEFINE_KERNELS)
+
+#undef IN_T
+#undef OUT_T
+#undef KERNEL_T
+#undef PRECISION_KERNEL
+#undef PACK
+#undef MACRO_KERNEL
+#undef SCRATCH
+#undef PRECISION_PREFIX
@@ -0,0 +1,246 @@
+#include "matrix.h"
+#include "kernel.h"
+#include "trace.h"
+
+// Square part of blocked matrix: blocks x blocks blocks starting from block (block_i, block_j)
+typedef struct {
+    double_matrix_t matrix;
+    int block_i;
+    int block_j;
+    int blocks;
+} blocked_view_t;
+
+static inline int view_block_size(blocked_view_t view) {
+    return view.matrix.minfo.blocked_info.block_size;
+}
+
+static inline double *view_block(blocked_view_t view, int block_i, int block_j) {
+    int block_size = view_block_size(view);
+    return (double *) view.matrix.data
+        + matrix_blocked_block_index(view.matrix, view.block_i + block_i, view.block_j + block_j) * block_size * block_size;
+}
+
+// Returns one of 4 quadrants of view (i, j are 0 or 1)
+static inline blocked_view_t view_quadrant(blocked_view_t view, int i, int j) {
+    int half = view.blocks / 2;
+    return (blocked_view_t) {
+        .matrix = view.matrix,
+        .block_i = view.block_i + i * half,
+        .block_j = view.block_j + j * half,
+        .blocks = half
+    };
+}
+
+// View of blocks x blocks NORMAL_BLOCKED matrix stored in data
+static blocked_view_t view_of(double *data, int blocks, int block_size) {
+    return (blocked_view_t) {
+        .matrix = {
+            .type = NORMAL_BLOCKED,
+            .minfo.blocked_info = { .block_size = block_size, .blocks_in_row = blocks },
+            .ncols = blocks * block_size,
+            .nrows = blocks * block_size,
+            .data = data
+        },
+        .blocks = blocks
+    };
+}
+
+// out = a + sign * b
+static void view_add(blocked_view_t out, blocked_view_t a, blocked_view_t b, double sign) {
+    int size = view_block_size(out) * view_block_size(out);
+    for (int block_i = 0; block_i < out.blocks; block_i++)
+        for (int block_j = 0; block_j < out.blocks; block_j++) {
+            double *out_block = view_block(out, block_i, block_j);
+            const double *a_block = view_block(a, block_i, block_j);
+            const double *b_block = view_block(b, block_i, block_j);
+            for (int i = 0; i < size; i++)
+                out_block[i] = a_block[i] + sign * b_block[i];
+        }
+}
+
+// out += sign * a
+static void view_accumulate(blocked_view_t out, blocked_view_t a, double sign) {
+    view_add(out, out, a, sign);
+}
+
+static void view_zero(blocked_view_t view) {
+    int size = view_block_size(view) * view_block_size(view);
+    for (int block_i = 0; block_i < view.blocks; block_i++)
+        for (int block_j = 0; block_j < view.blocks; block_j++)
+            memset(view_block(view, block_i, block_j), 0, sizeof(double) * size);
+}
+
+// Base case: out += m1 * m2 with packed SIMD kernel, same as for UPPER_TRIANGULAR_BLOCKED x NORMAL_BLOCKED.
+// If triangular, blocks of m1 under diagonal are zero and are skipped. b_packed holds block row of m2,
+// which is packed once for all block rows of out
+static void blocked_mult(
+    blocked_view_t m1, blocked_view_t m2, blocked_view_t out, int triangular, double *a_packed, double *b_packed
+) {
+    MATRIX_TRACE_BEGIN(span, "strassen_base");
+    const matrix_kernel_t *kernel = matrix_kernel_select();
+    int block_size = view_block_size(out);
+    size_t b_block_size = matrix_kernel_packed_b_size(kernel, block_size, block_size);
+    for (int block_k = 0; block_k < m2.blocks; block_k++) {
+        for (int block_j = 0; block_j < out.blocks; block_j++)
+            matrix_kernel_pack_b(
+                kernel, block_size, block_size, view_block(m2, block_k, block_j), block_size, 1, b_packed + block_j * b_block_size
+            );
+        for (int block_i = 0; block_i < (triangular ? block_k + 1 : out.blocks); block_i++) {
+            matrix_kernel_pack_a(kernel, block_size, block_size, view_block(m1, block_i, block_k), block_size, 1, a_packed);
+            for (int block_j = 0; block_j < out.blocks; block_j++) {
+                matrix_kernel_macro(
+                    kernel, block_size, block_size, block_size, a_packed, b_packed + block_j * b_block_size,
+                    view_block(out, block_i, block_j), block_size,
+                    triangular ? (block_i - block_k) * block_size : MATRIX_KERNEL_DENSE
+                );
+            }
+        }
+    }
+    MATRIX_TRACE_END(span);
+}
+
+#define STRASSEN_MAX_LEVELS 32
+
+// Temporaries of every level of recursion are parts of one workspace. Products of one level
+// run one after another, so all of them reuse 3 temporaries of the level
+typedef struct {
+    int cutoff;
+    int blocks;
+    double *a_packed;
+    double *b_packed;
+    double *temporaries[STRASSEN_MAX_LEVELS];
+} strassen_context_t;
+
+static int strassen_is_base_case(strassen_context_t *ctx, blocked_view_t view) {
+    return view.blocks % 2 != 0 || view.blocks * view_block_size(view) <= ctx->cutoff;
+}
+
+// out += m1 * m2 with Strassen-Winograd, scheduled to use only 3 temporaries per level
+static void strassen_dense(strassen_context_t *ctx, blocked_view_t m1, blocked_view_t m2, blocked_view_t out) {
+    if (strassen_is_base_case(ctx, out)) {
+        blocked_mult(m1, m2, out, 0, ctx->a_packed, ctx->b_packed);
+        return;
+    }
+
+    blocked_view_t a11 = view_quadrant(m1, 0, 0), a12 = view_quadrant(m1, 0, 1);
+    blocked_view_t a21 = view_quadrant(m1, 1, 0), a22 = view_quadrant(m1, 1, 1);
+    blocked_view_t b11 = view_quadrant(m2, 0, 0), b12 = view_quadrant(m2, 0, 1);
+    blocked_view_t b21 = view_quadrant(m2, 1, 0), b22 = view_quadrant(m2, 1, 1);
+    blocked_view_t c11 = view_quadrant(out, 0, 0), c12 = view_quadrant(out, 0, 1);
+    blocked_view_t c21 = view_quadrant(out, 1, 0), c22 = view_quadrant(out, 1, 1);
+
+    int half = out.blocks / 2, block_size = view_block_size(out), level = 0;
+    while ((ctx->blocks >> level) > out.blocks) level++;
+    size_t temporary_size = (size_t) half * half * block_size * block_size;
+    blocked_view_t x = view_of(ctx->temporaries[level], half, block_size);
+    blocked_view_t y = view_of(ctx->temporaries[level] + temporary_size, half, block_size);
+    blocked_view_t z = view_of(ctx->temporaries[level] + 2 * temporary_size, half, block_size);
+
+    // P1 = A11 * B11 goes to every quadrant
+    view_zero(z);
+    strassen_dense(ctx, a11, b11, z);
+    view_accumulate(c11, z, 1);
+    view_accumulate(c12, z, 1);
+    view_accumulate(c21, z, 1);
+    view_accumulate(c22, z, 1);
+    // P2 = A12 * B21
+    strassen_dense(ctx, a12, b21, c11);
+    // P5 = S1 * T1, S1 = A21 + A22, T1 = B12 - B11
+    view_add(x, a21, a22, 1);
+    view_add(y, b12, b11, -1);
+    view_zero(z);
+    strassen_dense(ctx, x, y, z);
+    view_accumulate(c12, z, 1);
+    view_accumulate(c22, z, 1);
+    // P6 = S2 * T2, S2 = S1 - A11, T2 = B22 - T1
+    view_accumulate(x, a11, -1);
+    view_add(y, b22, y, -1);
+    view_zero(z);
+    strassen_dense(ctx, x, y, z);
+    view_accumulate(c12, z, 1);
+    view_accumulate(c21, z, 1);
+    view_accumulate(c22, z, 1);
+    // P3 = S4 * B22, S4 = A12 - S2
+    view_add(x, a12, x, -1);
+    strassen_dense(ctx, x, b22, c12);
+    // P4 = A22 * T4, T4 = T2 - B21
+    view_accumulate(y, b21, -1);
+    view_zero(z);
+    strassen_dense(ctx, a22, y, z);
+    view_accumulate(c21, z, -1);
+    // P7 = S3 * T3, S3 = A11 - A21, T3 = B22 - B12
+    view_add(x, a11, a21, -1);
+    view_add(y, b22, b12, -1);
+    view_zero(z);
+    strassen_dense(ctx, x, y, z);
+    view_accumulate(c21, z, 1);
+    view_accumulate(c22, z, 1);
+}
+
+// out += m1 * m2 for upper triangular m1. Since A21 is zero, only A12 products
+// are dense (and go to Strassen-Winograd), diagonal quadrants are triangular again
+static void strassen_triangular(strassen_context_t *ctx, blocked_view_t m1, blocked_view_t m2, blocked_view_t out) {
+    if (strassen_is_base_case(ctx, out)) {
+        blocked_mult(m1, m2, out, 1, ctx->a_packed, ctx->b_packed);
+        return;
+    }
+
+    blocked_view_t a11 = view_quadrant(m1, 0, 0), a12 = view_quadrant(m1, 0, 1);
+    blocked_view_t a22 = view_quadrant(m1, 1, 1);
+    blocked_view_t b11 = view_quadrant(m2, 0, 0), b12 = view_quadrant(m2, 0, 1);
+    blocked_view_t b21 = view_quadrant(m2, 1, 0), b22 = view_quadrant(m2, 1, 1);
+    blocked_view_t c11 = view_quadrant(out, 0, 0), c12 = view_quadrant(out, 0, 1);
+    blocked_view_t c21 = view_quadrant(out, 1, 0), c22 = view_quadrant(out, 1, 1);
+
+    strassen_triangular(ctx, a11, b11, c11);
+    strassen_dense(ctx, a12, b21, c11);
+    strassen_triangular(ctx, a11, b12, c12);
+    strassen_dense(ctx, a12, b22, c12);
+    strassen_triangular(ctx, a22, b21, c21);
+    strassen_triangular(ctx, a22, b22, c22);
+}
+
+void matrix_strassen_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int cutoff) {
+    assert((m1.type == UPPER_TRIANGULAR_BLOCKED || m1.type == NORMAL_BLOCKED) && m2.type == NORMAL_BLOCKED && out.type == NORMAL_BLOCKED);
+    assert(out.nrows == m1.nrows && out.ncols == m2.ncols && m1.ncols == m2.nrows);
+    assert(m1.ncols == m1.nrows && m2.ncols == m2.nrows);
+    int block_size = out.minfo.blocked_info.block_size;
+    assert(m1.minfo.blocked_info.block_size == block_size && m2.minfo.blocked_info.block_size == block_size);
+
+    int blocks = out.minfo.blocked_info.blocks_in_row;
+    const matrix_kernel_t *kernel = matrix_kernel_select();
+    strassen_context_t ctx = {
+        .cutoff = cutoff,
+        .blocks = blocks,
+        .a_packed = matrix_kernel_scratch(MATRIX_KERNEL_SCRATCH_A, matrix_kernel_packed_a_size(kernel, block_size, block_size)),
+        // Note: base case has at most blocks blocks in row
+        .b_packed = matrix_kernel_scratch(MATRIX_KERNEL_SCRATCH_B, blocks * matrix_kernel_packed_b_size(kernel, block_size, block_size))
+    };
+
+    // Note: workspace is allocated once per call (from arena of calling thread, if it uses one),
+    // dense level of n x n blocks which is not base case has 3 temporaries of n / 2 x n / 2 blocks,
+    // triangular top level has none
+    size_t workspace_size = 0;
+    size_t level_sizes[STRASSEN_MAX_LEVELS];
+    int levels = 0;
+    for (blocked_view_t level = { .matrix = out, .blocks = blocks }; !strassen_is_base_case(&ctx, level); level.blocks /= 2) {
+        assert(levels < STRASSEN_MAX_LEVELS);
+        int dense = levels > 0 || m1.type == NORMAL_BLOCKED;
+        level_sizes[levels] = dense ? 3 * (size_t) (level.blocks / 2) * (level.blocks / 2) * block_size * block_size : 0;
+        workspace_size += level_sizes[levels++];
+    }
+    double *workspace = workspace_size ? matrix_alloc_data(sizeof(double) * workspace_size) : NULL;
+    size_t offset = 0;
+    for (int level = 0; level < levels; offset += level_sizes[level++])
+        ctx.temporaries[level] = workspace + offset;
+
+    blocked_view_t m1_view = { .matrix = m1, .blocks = blocks };
+    blocked_view_t m2_view = { .matrix = m2, .blocks = blocks };
+    blocked_view_t out_view = { .matrix = out, .blocks = blocks };
+    if (m1.type == UPPER_TRIANGULAR_BLOCKED)
+        strassen_triangular(&ctx, m1_view, m2_view, out_view);
+    else
+        strassen_dense(&ctx, m1_view, m2_view, out_view);
+
+    matrix_free_data(workspace);
+}
@@ -0,0 +1,200 @@
+#include "matrix.h"
+#include "pool.h"
+#include <pthread.h>
+
+// Converted matrices of two jobs: one is multiplied while the other is converted
+#define STREAM_SLOTS 2
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_CONVERTED,
+    JOB_MULTIPLIED,
+    JOB_DONE
+} job_state_t;
+
+struct matrix_stream_job {
+    double_matrix_t m1;
+    double_matrix_t m2;
+    double_matrix_t out;
+    int slot;
+    job_state_t state;
+    matrix_stream_job_t *next;
+};
+
+// Blocked copies of inputs and output of one job, reused by next jobs of the same shape
+typedef struct {
+    double_matrix_t m1;
+    double_matrix_t m2;
+    double_matrix_t out;
+    int used;
+} slot_t;
+
+struct matrix_stream {
+    int block_size;
+    slot_t slots[STREAM_SLOTS];
+    // Note: jobs which are not done yet in order of submission, every stage takes them in it
+    matrix_stream_job_t *head;
+    matrix_stream_job_t *tail;
+    int shutdown;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    pthread_t converter;
+    pthread_t multiplier;
+};
+
+static matrix_stream_job_t *first_in_state(matrix_stream_t *stream, job_state_t state) {
+    for (matrix_stream_job_t *job = stream->head; job; job = job->next)
+        if (job->state == state) return job;
+    return NULL;
+}
+
+static int free_slot(matrix_stream_t *stream) {
+    for (int slot = 0; slot < STREAM_SLOTS; slot++)
+        if (!stream->slots[slot].used) return slot;
+    return -1;
+}
+
+// Returns zeroed blocked matrix of given shape, m is reused if it already has it.
+// Note: converters skip zero tiles of triangular sources, and previous job of the same
+// shape might have had operand of other type, so reused m is zeroed again too
+static double_matrix_t reuse_or_allocate(double_matrix_t m, matrix_type_t type, int nrows, int ncols, int block_size) {
+    if (m.data && m.type == type && m.nrows == nrows && m.ncols == ncols) {
+        memset(m.data, 0, sizeof(double) * matrix_storage_size(type, nrows, ncols, block_size));
+        return m;
+    }
+    matrix_free(m);
+    return type == UPPER_TRIANGULAR_BLOCKED
+        ? matrix_allocate_upper_triangular_blocked(nrows, block_size)
+        : matrix_allocate_blocked_rectangular(nrows, ncols, block_size);
+}
+
+static void set_state(matrix_stream_t *stream, matrix_stream_job_t *job, job_state_t state) {
+    job->state = state;
+    pthread_cond_broadcast(&stream->changed);
+}
+
+// Converts inputs of queued jobs into free slots and results of multiplied jobs back into
+// their outputs, results go first as they free slots
+static void *converter_main(void *arg) {
+    matrix_stream_t *stream = arg;
+    // Note: conversions run on one core, multiplication keeps the others
+    omp_set_num_threads(1);
+    pthread_mutex_lock(&stream->mutex);
+    for (;;) {
+        matrix_stream_job_t *job = first_in_state(stream, JOB_MULTIPLIED);
+        if (job) {
+            slot_t *slot = &stream->slots[job->slot];
+            pthread_mutex_unlock(&stream->mutex);
+            matrix_convert(slot->out, job->out);
+            pthread_mutex_lock(&stream->mutex);
+            slot->used = 0;
+            // Note: jobs are multiplied in order, so multiplied job is the oldest one
+            assert(job == stream->head);
+            stream->head = job->next;
+            if (!stream->head) stream->tail = NULL;
+            set_state(stream, job, JOB_DONE);
+            continue;
+        }
+
+        job = first_in_state(stream, JOB_QUEUED);
+        int slot_index = free_slot(stream);
+        if (job && slot_index >= 0) {
+            slot_t *slot = &stream->slots[slot_index];
+            slot->used = 1;
+            job->slot = slot_index;
+            pthread_mutex_unlock(&stream->mutex);
+            // Note: multiplication accumulates into out
+            slot->m1 = reuse_or_allocate(slot->m1, UPPER_TRIANGULAR_BLOCKED, job->m1.nrows, job->m1.ncols, stream->block_size);
+            slot->m2 = reuse_or_allocate(slot->m2, NORMAL_BLOCKED, job->m2.nrows, job->m2.ncols, stream->block_size);
+            slot->out = reuse_or_allocate(slot->out, NORMAL_BLOCKED, job->out.nrows, job->out.ncols, stream->block_size);
+            matrix_convert(job->m1, slot->m1);
+            matrix_convert(job->m2, slot->m2);
+            pthread_mutex_lock(&stream->mutex);
+            set_state(stream, job, JOB_CONVERTED);
+            continue;
+        }
+
+        if (stream->shutdown && !stream->head) break;
+        pthread_cond_wait(&stream->changed, &stream->mutex);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return NULL;
+}
+
+// Multiplies converted jobs one by one on pool of worker threads
+static void *multiplier_main(void *arg) {
+    matrix_stream_t *stream = arg;
+    pthread_mutex_lock(&stream->mutex);
+    for (;;) {
+        matrix_stream_job_t *job = first_in_state(stream, JOB_CONVERTED);
+        if (job) {
+            slot_t *slot = &stream->slots[job->slot];
+            pthread_mutex_unlock(&stream->mutex);
+            matrix_omp_mult_block3(slot->m1, slot->m2, slot->out, stream->block_size);
+            pthread_mutex_lock(&stream->mutex);
+            set_state(stream, job, JOB_MULTIPLIED);
+            continue;
+        }
+
+        if (stream->shutdown && !stream->head) break;
+        pthread_cond_wait(&stream->changed, &stream->mutex);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return NULL;
+}
+
+matrix_stream_t *matrix_stream_create(int block_size) {
+    assert(block_size > 0);
+    matrix_stream_t *stream = calloc(1, sizeof(matrix_stream_t));
+    stream->block_size = block_size;
+    // Note: pool is created here, not lazily by multiplier thread
+    matrix_pool_threads();
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->changed, NULL);
+    int error = pthread_create(&stream->converter, NULL, converter_main, stream)
+        || pthread_create(&stream->multiplier, NULL, multiplier_main, stream);
+    assert(!error && "could not create stream threads");
+    return stream;
+}
+
+void matrix_stream_destroy(matrix_stream_t *stream) {
+    pthread_mutex_lock(&stream->mutex);
+    stream->shutdown = 1;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->mutex);
+    pthread_join(stream->converter, NULL);
+    pthread_join(stream->multiplier, NULL);
+
+    for (int slot = 0; slot < STREAM_SLOTS; slot++) {
+        matrix_free(stream->slots[slot].m1);
+        matrix_free(stream->slots[slot].m2);
+        matrix_free(stream->slots[slot].out);
+    }
+    pthread_mutex_destroy(&stream->mutex);
+    pthread_cond_destroy(&stream->changed);
+    free(stream);
+}
+
+matrix_stream_job_t *matrix_stream_submit(matrix_stream_t *stream, double_matrix_t m1, double_matrix_t m2, double_matrix_t out) {
+    assert(m1.type == UPPER_TRIANGULAR_COLS || m1.type == UPPER_TRIANGULAR_BLOCKED);
+    assert(out.nrows == m1.nrows && out.ncols == m2.ncols && m1.ncols == m2.nrows);
+    matrix_stream_job_t *job = malloc(sizeof(matrix_stream_job_t));
+    *job = (matrix_stream_job_t) { .m1 = m1, .m2 = m2, .out = out, .state = JOB_QUEUED };
+
+    pthread_mutex_lock(&stream->mutex);
+    assert(!stream->shutdown);
+    if (stream->tail) stream->tail->next = job;
+    else stream->head = job;
+    stream->tail = job;
+    pthread_cond_broadcast(&stream->changed);
+    pthread_mutex_unlock(&stream->mutex);
+    return job;
+}
+
+void matrix_stream_wait(matrix_stream_t *stream, matrix_stream_job_t *job) {
+    pthread_mutex_lock(&stream->mutex);
+    while (job->state != JOB_DONE)
+        pthread_cond_wait(&stream->changed, &stream->mutex);
+    pthread_mutex_unlock(&stream->mutex);
+    free(job);
+}
@@ -0,0 +1,298 @@
+#include "summa.h"
+#include "kernel.h"
+#include "trace.h"
+#include <omp.h>
+#include <math.h>
+#include <stdio.h>
+
+// Number of blocks with index % count == index_mod among first blocks
+static int local_count(int blocks, int count, int index_mod) {
+    return blocks / count + (index_mod < blocks % count);
+}
+
+void matrix_summa_grid_create(MPI_Comm comm, int dims, int block_size, matrix_summa_grid_t *grid) {
+    int size, rank;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+
+    int rows = 1;
+    for (int i = 1; i * i <= size; i++)
+        if (size % i == 0) rows = i;
+
+    grid->comm = comm;
+    grid->rows = rows;
+    grid->cols = size / rows;
+    grid->row = rank / grid->cols;
+    grid->col = rank % grid->cols;
+    grid->dims = dims;
+    grid->blocks = matrix_blocks(dims, block_size);
+    grid->block_size = block_size;
+    grid->local_rows = local_count(grid->blocks, grid->rows, grid->row);
+    grid->local_cols = local_count(grid->blocks, grid->cols, grid->col);
+    MPI_Comm_split(comm, grid->row, grid->col, &grid->row_comm);
+    MPI_Comm_split(comm, grid->col, grid->row, &grid->col_comm);
+}
+
+void matrix_summa_grid_free(matrix_summa_grid_t *grid) {
+    MPI_Comm_free(&grid->row_comm);
+    MPI_Comm_free(&grid->col_comm);
+}
+
+double *matrix_summa_allocate_local(const matrix_summa_grid_t *grid) {
+    size_t block_elements = (size_t) grid->block_size * grid->block_size;
+    return calloc((size_t) MAX(1, grid->local_rows * grid->local_cols) * block_elements, sizeof(double));
+}
+
+// Copies blocks owned by rank at (row, col) from local array of them to global blocked out
+static void copy_local_blocks(const matrix_summa_grid_t *grid, double *local, double_matrix_t out, int row, int col) {
+    int block_size = grid->block_size;
+    size_t block_bytes = sizeof(double) * block_size * block_size;
+    int local_rows = local_count(grid->blocks, grid->rows, row);
+    int local_cols = local_count(grid->blocks, grid->cols, col);
+    for (int local_i = 0; local_i < local_rows; local_i++)
+        for (int local_j = 0; local_j < local_cols; local_j++) {
+            int block_i = local_i * grid->rows + row;
+            int block_j = local_j * grid->cols + col;
+            double *local_block = local + ((size_t) local_i * local_cols + local_j) * block_size * block_size;
+            memcpy(matrix_blocked_subblock(out, block_i * block_size, block_j * block_size).data, local_block, block_bytes);
+        }
+}
+
+static size_t local_elements(const matrix_summa_grid_t *grid, int row, int col) {
+    return (size_t) local_count(grid->blocks, grid->rows, row) * local_count(grid->blocks, grid->cols, col)
+        * grid->block_size * grid->block_size;
+}
+
+void matrix_summa_fill_random(const matrix_summa_grid_t *grid, double *local, int triangular, uint64_t seed, uint64_t stream) {
+    int block_size = grid->block_size;
+    #pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int local_i = 0; local_i < grid->local_rows; local_i++)
+        for (int local_j = 0; local_j < grid->local_cols; local_j++) {
+            double *block = matrix_summa_local_block(grid, local, local_i, local_j);
+            for (int i = 0; i < block_size; i++)
+                for (int j = 0; j < block_size; j++) {
+                    int global_i = (local_i * grid->rows + grid->row) * block_size + i;
+                    int global_j = (local_j * grid->cols + grid->col) * block_size + j;
+                    int in_matrix = global_i < grid->dims && global_j < grid->dims && (!triangular || global_i <= global_j);
+                    block[i * block_size + j] = in_matrix ? matrix_random_value(seed, stream, global_i, global_j) : 0;
+                }
+        }
+}
+
+void matrix_summa_gather(const matrix_summa_grid_t *grid, double *local, double_matrix_t out, int root) {
+    int rank, size;
+    MPI_Comm_rank(grid->comm, &rank);
+    MPI_Comm_size(grid->comm, &size);
+    if (rank != root) {
+        MPI_Send(local, local_elements(grid, grid->row, grid->col), MPI_DOUBLE, root, 0, grid->comm);
+        return;
+    }
+
+    assert(out.type == NORMAL_BLOCKED);
+    assert(out.nrows == grid->dims && out.ncols == grid->dims && out.minfo.blocked_info.block_size == grid->block_size);
+    double *buffer = malloc(sizeof(double) * MAX(1, local_elements(grid, 0, 0)));
+    for (int source = 0; source < size; source++) {
+        int row = source / grid->cols, col = source % grid->cols;
+        if (source == root) {
+            copy_local_blocks(grid, local, out, row, col);
+            continue;
+        }
+        MPI_Recv(buffer, local_elements(grid, row, col), MPI_DOUBLE, source, 0, grid->comm, MPI_STATUS_IGNORE);
+        copy_local_blocks(grid, buffer, out, row, col);
+    }
+    free(buffer);
+}
+
+// Adds m v (|m| v with absolute) of local blocks of m to y, vectors have all padded elements
+static void local_mult_vector(const matrix_summa_grid_t *grid, double *m, const double *v, double *y, int absolute) {
+    int block_size = grid->block_size;
+    // Note: every local block row adds to its own part of y
+    #pragma omp parallel for schedule(static)
+    for (int local_i = 0; local_i < grid->local_rows; local_i++) {
+        double *y_block = y + (size_t) (local_i * grid->rows + grid->row) * block_size;
+        for (int local_j = 0; local_j < grid->local_cols; local_j++) {
+            const double *v_block = v + (size_t) (local_j * grid->cols + grid->col) * block_size;
+            double *block = matrix_summa_local_block(grid, m, local_i, local_j);
+            for (int i = 0; i < block_size; i++) {
+                double sum = 0;
+                for (int j = 0; j < block_size; j++)
+                    sum += (absolute ? fabs(block[i * block_size + j]) : block[i * block_size + j]) * v_block[j];
+                y_block[i] += sum;
+            }
+        }
+    }
+}
+
+// Sets y to m v (|m| v with absolute) of the whole distributed m on all ranks
+static void summa_mult_vector(const matrix_summa_grid_t *grid, double *m, const double *v, double *y, int absolute) {
+    size_t n = (size_t) grid->blocks * grid->block_size;
+    memset(y, 0, sizeof(double) * n);
+    local_mult_vector(grid, m, v, y, absolute);
+    MPI_Allreduce(MPI_IN_PLACE, y, n, MPI_DOUBLE, MPI_SUM, grid->comm);
+}
+
+int matrix_summa_freivalds_verify(const matrix_summa_grid_t *grid, double *a, double *b, double *c, int rounds, double tolerance) {
+    assert(rounds > 0);
+    int rank;
+    MPI_Comm_rank(grid->comm, &rank);
+    size_t n = (size_t) grid->blocks * grid->block_size;
+    double *r = calloc(n, sizeof(double));
+    double *b_r = malloc(sizeof(double) * n);
+    double *a_b_r = malloc(sizeof(double) * n);
+    double *c_r = malloc(sizeof(double) * n);
+
+    // Note: bound of rounding errors is the same as in matrix_freivalds_verify, padding of r is zero
+    for (int j = 0; j < grid->dims; j++) r[j] = 1;
+    summa_mult_vector(grid, b, r, b_r, 1);
+    summa_mult_vector(grid, a, b_r, a_b_r, 1);
+    double max_bound = 0;
+    for (int i = 0; i < grid->dims; i++) max_bound = MAX(max_bound, a_b_r[i]);
+
+    int ok = 1;
+    for (int round = 0; round < rounds && ok; round++) {
+        // Note: r is drawn on rank 0, so results do not depend on rand() of other ranks
+        if (rank == 0)
+            for (int j = 0; j < grid->dims; j++) r[j] = rand() & 1 ? 1 : -1;
+        MPI_Bcast(r, n, MPI_DOUBLE, 0, grid->comm);
+        summa_mult_vector(grid, b, r, b_r, 0);
+        summa_mult_vector(grid, a, b_r, a_b_r, 0);
+        summa_mult_vector(grid, c, r, c_r, 0);
+        for (int i = 0; i < grid->dims; i++)
+            if (fabs(a_b_r[i] - c_r[i]) > tolerance * max_bound) {
+                if (rank == 0)
+                    printf("MATRIX NOT SAME: row %d, %.6f != %.6f in round %d\n", i, a_b_r[i], c_r[i], round);
+                ok = 0;
+                break;
+            }
+    }
+
+    free(r);
+    free(b_r);
+    free(a_b_r);
+    free(c_r);
+    return ok;
+}
+
+// Panels of step k: nonzero local blocks of block column k of a (local rows with
+// block_i <= k when a is triangular) and local blocks of block row k of b
+typedef struct {
+    double *a;
+    double *b;
+    int a_blocks;
+    MPI_Request requests[2];
+} summa_panels_t;
+
+static int panel_a_blocks(const matrix_summa_grid_t *grid, int k, int triangular) {
+    if (!triangular) return grid->local_rows;
+    // Note: local block rows are increasing, so nonzero ones are prefix
+    return k < grid->row ? 0 : MIN(grid->local_rows, (k - grid->row) / grid->rows + 1);
+}
+
+// Starts broadcasts of panels of step k, owners copy their blocks into panels first
+static void panels_start(const matrix_summa_grid_t *grid, summa_panels_t *panels, double *a, double *b, int k, int triangular) {
+    size_t block_elements = (size_t) grid->block_size * grid->block_size;
+    int a_owner = k % grid->cols, b_owner = k % grid->rows;
+    panels->a_blocks = panel_a_blocks(grid, k, triangular);
+
+    if (grid->col == a_owner)
+        for (int local_i = 0; local_i < panels->a_blocks; local_i++)
+            memcpy(
+                panels->a + local_i * block_elements,
+                matrix_summa_local_block(grid, a, local_i, k / grid->cols),
+                sizeof(double) * block_elements
+            );
+    if (grid->row == b_owner)
+        for (int local_j = 0; local_j < grid->local_cols; local_j++)
+            memcpy(
+                panels->b + local_j * block_elements,
+                matrix_summa_local_block(grid, b, k / grid->rows, local_j),
+                sizeof(double) * block_elements
+            );
+
+    // Note: all ranks of grid row have the same local rows, so they agree on a_blocks
+    panels->requests[0] = MPI_REQUEST_NULL;
+    if (panels->a_blocks > 0)
+        MPI_Ibcast(panels->a, panels->a_blocks * block_elements, MPI_DOUBLE, a_owner, grid->row_comm, &panels->requests[0]);
+    MPI_Ibcast(panels->b, grid->local_cols * block_elements, MPI_DOUBLE, b_owner, grid->col_comm, &panels->requests[1]);
+}
+
+// Multiplies panels of step k into c: packs every block once, then all local
+// blocks of c are computed in parallel. Note: MPI progresses non-blocking broadcasts
+// only inside MPI calls, so master thread tests broadcasts of next panels between blocks
+static void panels_multiply(
+    const matrix_summa_grid_t *grid, summa_panels_t *panels, summa_panels_t *next, double *c, int k, int triangular,
+    double *a_packed, double *b_packed
+) {
+    const matrix_kernel_t *kernel = matrix_kernel_select();
+    int block_size = grid->block_size;
+    size_t block_elements = (size_t) block_size * block_size;
+    size_t a_packed_size = matrix_kernel_packed_a_size(kernel, block_size, block_size);
+    size_t b_packed_size = matrix_kernel_packed_b_size(kernel, block_size, block_size);
+    int a_blocks = panels->a_blocks;
+    if (a_blocks == 0) return;
+
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(static) nowait
+        for (int local_i = 0; local_i < a_blocks; local_i++)
+            matrix_kernel_pack_a(kernel, block_size, block_size, panels->a + local_i * block_elements, block_size, 1, a_packed + local_i * a_packed_size);
+        #pragma omp for schedule(static)
+        for (int local_j = 0; local_j < grid->local_cols; local_j++)
+            matrix_kernel_pack_b(kernel, block_size, block_size, panels->b + local_j * block_elements, block_size, 1, b_packed + local_j * b_packed_size);
+
+        #pragma omp for collapse(2) schedule(dynamic)
+        for (int local_i = 0; local_i < a_blocks; local_i++)
+            for (int local_j = 0; local_j < grid->local_cols; local_j++) {
+                int block_i = local_i * grid->rows + grid->row;
+                matrix_kernel_macro(
+                    kernel, block_size, block_size, block_size,
+                    a_packed + local_i * a_packed_size, b_packed + local_j * b_packed_size,
+                    matrix_summa_local_block(grid, c, local_i, local_j), block_size,
+                    triangular ? (block_i - k) * block_size : MATRIX_KERNEL_DENSE
+                );
+                if (next && omp_get_thread_num() == 0) {
+                    int done;
+                    MPI_Testall(2, next->requests, &done, MPI_STATUSES_IGNORE);
+                }
+            }
+    }
+}
+
+void matrix_summa_mult3(const matrix_summa_grid_t *grid, double *a, double *b, double *c, int triangular) {
+    const matrix_kernel_t *kernel = matrix_kernel_select();
+    int block_size = grid->block_size;
+    size_t block_elements = (size_t) block_size * block_size;
+    int local_rows = MAX(1, grid->local_rows), local_cols = MAX(1, grid->local_cols);
+
+    // Note: panels are double buffered, broadcast of the next one goes during multiplication
+    summa_panels_t panels[2];
+    for (int i = 0; i < 2; i++) {
+        panels[i].a = matrix_kernel_alloc(local_rows * block_elements);
+        panels[i].b = matrix_kernel_alloc(local_cols * block_elements);
+    }
+    double *a_packed = matrix_kernel_alloc(local_rows * matrix_kernel_packed_a_size(kernel, block_size, block_size));
+    double *b_packed = matrix_kernel_alloc(local_cols * matrix_kernel_packed_b_size(kernel, block_size, block_size));
+
+    panels_start(grid, &panels[0], a, b, 0, triangular);
+    for (int k = 0; k < grid->blocks; k++) {
+        summa_panels_t *current = &panels[k % 2];
+        MATRIX_TRACE_BEGIN(wait_span, "summa_wait");
+        MPI_Waitall(2, current->requests, MPI_STATUSES_IGNORE);
+        MATRIX_TRACE_END(wait_span);
+        summa_panels_t *next = NULL;
+        if (k + 1 < grid->blocks) {
+            next = &panels[(k + 1) % 2];
+            panels_start(grid, next, a, b, k + 1, triangular);
+        }
+        MATRIX_TRACE_BEGIN(multiply_span, "summa_multiply");
+        panels_multiply(grid, current, next, c, k, triangular, a_packed, b_packed);
+        MATRIX_TRACE_END(multiply_span);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        free(panels[i].a);
+        free(panels[i].b);
+    }
+    free(a_packed);
+    free(b_packed);
+}
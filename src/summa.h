@@ -0,0 +1,57 @@
+#ifndef SUMMA_H
+#define SUMMA_H
+
+#include "matrix.h"
+#include <mpi.h>
+
+// Ranks form rows x cols grid, block (block_i, block_j) of global blocked matrix is owned by
+// rank (block_i % rows, block_j % cols) (2D block-cyclic). Local part of matrix is plain array
+// of local_rows x local_cols blocks, local block (local_i, local_j) is global block
+// (local_i * rows + row, local_j * cols + col). Edge blocks are padded with zeros when block
+// size does not divide dims
+typedef struct {
+    MPI_Comm comm;
+    MPI_Comm row_comm; // ranks with the same row, rank in it is col
+    MPI_Comm col_comm; // ranks with the same col, rank in it is row
+    int rows;
+    int cols;
+    int row;
+    int col;
+    int dims;
+    int blocks;
+    int block_size;
+    int local_rows;
+    int local_cols;
+} matrix_summa_grid_t;
+
+// Collective, grid is as close to square as number of ranks allows
+void matrix_summa_grid_create(MPI_Comm comm, int dims, int block_size, matrix_summa_grid_t *grid);
+void matrix_summa_grid_free(matrix_summa_grid_t *grid);
+
+// Allocates zeroed local part of matrix
+double *matrix_summa_allocate_local(const matrix_summa_grid_t *grid);
+
+static inline double *matrix_summa_local_block(const matrix_summa_grid_t *grid, double *local, int local_i, int local_j) {
+    return local + ((size_t) local_i * grid->local_cols + local_j) * grid->block_size * grid->block_size;
+}
+
+// Fills local blocks with the same values as matrix_fill_random(m, seed, stream) gives to
+// elements of global matrix, so matrix is generated without sending it. With triangular
+// elements under diagonal are zero
+void matrix_summa_fill_random(const matrix_summa_grid_t *grid, double *local, int triangular, uint64_t seed, uint64_t stream);
+// Collective, out is NORMAL_BLOCKED matrix on root (ignored on other ranks). Root receives
+// the whole matrix, so it is for sizes fitting in memory of one rank
+void matrix_summa_gather(const matrix_summa_grid_t *grid, double *local, double_matrix_t out, int root);
+
+// Collective, matrix_freivalds_verify of c = a * b over local parts: products with vectors are
+// computed locally and summed by reductions, so only vectors of dims are sent. Returns the same
+// on all ranks
+int matrix_summa_freivalds_verify(const matrix_summa_grid_t *grid, double *a, double *b, double *c, int rounds, double tolerance);
+
+// Collective, c += a * b with SUMMA: for every k block column of a and block row of b are
+// broadcast along rows and cols of grid. If a is upper triangular, blocks under its diagonal
+// are neither sent nor multiplied. Broadcasts of step k + 1 run while step k is multiplied,
+// so MPI must be initialized with at least MPI_THREAD_FUNNELED
+void matrix_summa_mult3(const matrix_summa_grid_t *grid, double *a, double *b, double *c, int triangular);
+
+#endif
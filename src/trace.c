@@ -0,0 +1,165 @@
+#include "trace.h"
+
+#ifdef MATRIX_TRACE
+
+#include "matrix.h"
+#include <omp.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Note: spans are appended to buffer of calling thread, buffers are linked
+// into global list once, so tracing itself never takes locks
+typedef struct trace_event {
+    const char *name;
+    double start;
+    double end;
+    long long counters[MATRIX_TRACE_COUNTERS];
+} trace_event_t;
+
+typedef struct trace_buffer {
+    trace_event_t *events;
+    size_t count;
+    size_t capacity;
+    long tid;
+    int omp_thread;
+    struct trace_buffer *next;
+} trace_buffer_t;
+
+static trace_buffer_t *buffers = NULL;
+static double trace_start = -1;
+
+static __thread trace_buffer_t *thread_buffer = NULL;
+// Group of counters of calling thread: group_fd is leader, index[c] is position of
+// counter c in group read, or -1 if it could not be opened
+static __thread int group_fd = -2;
+static __thread int group_index[MATRIX_TRACE_COUNTERS];
+
+static const char *counter_names[MATRIX_TRACE_COUNTERS] = {
+    [MATRIX_TRACE_CYCLES] = "cycles",
+    [MATRIX_TRACE_INSTRUCTIONS] = "instructions",
+    [MATRIX_TRACE_L1D_MISSES] = "l1d_misses",
+    [MATRIX_TRACE_LLC_MISSES] = "llc_misses"
+};
+
+static const struct { unsigned type; unsigned long long config; } counter_events[MATRIX_TRACE_COUNTERS] = {
+    [MATRIX_TRACE_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [MATRIX_TRACE_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [MATRIX_TRACE_L1D_MISSES] = {
+        PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    },
+    [MATRIX_TRACE_LLC_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+};
+
+static void counters_open(void) {
+    static int warned = 0;
+    group_fd = -1;
+    int members = 0;
+    for (int c = 0; c < MATRIX_TRACE_COUNTERS; c++) {
+        struct perf_event_attr attr = {
+            .type = counter_events[c].type,
+            .size = sizeof(struct perf_event_attr),
+            .config = counter_events[c].config,
+            .disabled = group_fd == -1,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+            .read_format = PERF_FORMAT_GROUP
+        };
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+        group_index[c] = fd >= 0 ? members++ : -1;
+        if (fd >= 0 && group_fd == -1) group_fd = fd;
+    }
+
+    if (group_fd == -1) {
+        if (!warned) fprintf(stderr, "Could not open hardware counters, only time is traced\n");
+        warned = 1;
+        return;
+    }
+    ioctl(group_fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static void counters_read(long long *counters) {
+    if (group_fd == -2) counters_open();
+    unsigned long long values[1 + MATRIX_TRACE_COUNTERS] = { 0 };
+    if (group_fd >= 0 && read(group_fd, values, sizeof(values)) <= 0) values[0] = 0;
+    for (int c = 0; c < MATRIX_TRACE_COUNTERS; c++)
+        counters[c] = group_index[c] >= 0 && (unsigned long long) group_index[c] < values[0] ? (long long) values[1 + group_index[c]] : -1;
+}
+
+static trace_buffer_t *buffer_of_thread(void) {
+    if (thread_buffer) return thread_buffer;
+    thread_buffer = calloc(1, sizeof(trace_buffer_t));
+    thread_buffer->tid = syscall(SYS_gettid);
+    thread_buffer->omp_thread = omp_get_thread_num();
+    #pragma omp critical(matrix_trace)
+    {
+        if (trace_start < 0) trace_start = omp_get_wtime();
+        thread_buffer->next = buffers;
+        buffers = thread_buffer;
+    }
+    return thread_buffer;
+}
+
+void matrix_trace_begin(matrix_trace_span_t *span, const char *name) {
+    buffer_of_thread();
+    span->name = name;
+    counters_read(span->counters);
+    span->start = omp_get_wtime();
+}
+
+void matrix_trace_end(matrix_trace_span_t *span) {
+    double end = omp_get_wtime();
+    long long counters[MATRIX_TRACE_COUNTERS];
+    counters_read(counters);
+
+    trace_buffer_t *buffer = buffer_of_thread();
+    if (buffer->count == buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+        buffer->events = realloc(buffer->events, sizeof(trace_event_t) * buffer->capacity);
+    }
+    trace_event_t *event = &buffer->events[buffer->count++];
+    event->name = span->name;
+    event->start = span->start;
+    event->end = end;
+    for (int c = 0; c < MATRIX_TRACE_COUNTERS; c++)
+        event->counters[c] = counters[c] >= 0 && span->counters[c] >= 0 ? counters[c] - span->counters[c] : -1;
+}
+
+// Note: should be called when no spans are recorded concurrently
+int matrix_trace_write(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Could not write trace %s\n", path);
+        return 0;
+    }
+
+    int first = 1;
+    fprintf(file, "{\"traceEvents\": [\n");
+    for (trace_buffer_t *buffer = buffers; buffer; buffer = buffer->next) {
+        fprintf(
+            file, "%s  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %ld, \"args\": {\"name\": \"omp thread %d\"}}",
+            first ? "" : ",\n", buffer->tid, buffer->omp_thread
+        );
+        first = 0;
+        for (size_t i = 0; i < buffer->count; i++) {
+            trace_event_t *event = &buffer->events[i];
+            fprintf(
+                file, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %ld, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+                event->name, buffer->tid, (event->start - trace_start) * 1e6, (event->end - event->start) * 1e6
+            );
+            int first_counter = 1;
+            for (int c = 0; c < MATRIX_TRACE_COUNTERS; c++) {
+                if (event->counters[c] < 0) continue;
+                fprintf(file, "%s\"%s\": %lld", first_counter ? "" : ", ", counter_names[c], event->counters[c]);
+                first_counter = 0;
+            }
+            fprintf(file, "}}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Optional instrumentation, enabled with -DMATRIX_TRACE (make TRACE=1). Every span records
+// start and end time of calling thread and, if perf_event_open is permitted, hardware counters
+// (cycles, instructions, L1D and LLC misses) of the thread during the span. Spans are written
+// as Chrome trace (also opened by Perfetto) with matrix_trace_write.
+// When disabled all macros compile to nothing
+
+#ifdef MATRIX_TRACE
+
+enum {
+    MATRIX_TRACE_CYCLES,
+    MATRIX_TRACE_INSTRUCTIONS,
+    MATRIX_TRACE_L1D_MISSES,
+    MATRIX_TRACE_LLC_MISSES,
+    MATRIX_TRACE_COUNTERS
+};
+
+typedef struct {
+    const char *name;
+    double start;
+    long long counters[MATRIX_TRACE_COUNTERS];
+} matrix_trace_span_t;
+
+void matrix_trace_begin(matrix_trace_span_t *span, const char *name);
+void matrix_trace_end(matrix_trace_span_t *span);
+// Writes all finished spans to path, returns 0 on failure
+int matrix_trace_write(const char *path);
+
+#define MATRIX_TRACE_BEGIN(span, name) matrix_trace_span_t span; matrix_trace_begin(&span, name)
+#define MATRIX_TRACE_END(span) matrix_trace_end(&span)
+#define MATRIX_TRACE_WRITE(path) matrix_trace_write(path)
+
+#else
+
+#define MATRIX_TRACE_BEGIN(span, name)
+#define MATRIX_TRACE_END(span)
+#define MATRIX_TRACE_WRITE(path) 1
+
+#endif
+
+#endif
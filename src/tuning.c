@@ -0,0 +1,376 @@
+#include "matrix.h"
+#include "kernel.h"
+#include "pool.h"
+#include <omp.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define TUNING_CACHE_ENV "MATRIX_TUNING_CACHE"
+#define TUNING_CACHE_FILE "fast_matrix_multiplication.tuning"
+#define TUNING_MAX_ENTRIES 256
+#define TUNING_KEY_SIZE 256
+
+// Each measurement takes best of this number of runs
+#define TUNING_RUNS 2
+
+typedef struct {
+    char key[TUNING_KEY_SIZE];
+    matrix_tuning_t tuning;
+} tuning_entry_t;
+
+// Kernel resolved for key of multiplication, so string keys are not formatted and
+// compared on every call. Keys without entry are resolved too, they use selected kernel
+typedef struct {
+    matrix_type_t m1_type;
+    matrix_type_t m2_type;
+    int parallel;
+    int dims;
+    int threads;
+    matrix_kernel_t kernel;
+} resolved_kernel_t;
+
+// Entries below count are never changed, so they are read without lock. Table is
+// replaced when full or invalidated, replaced tables are kept as readers might search them
+typedef struct resolved_table {
+    int capacity;
+    atomic_int count;
+    struct resolved_table *replaced;
+    resolved_kernel_t entries[];
+} resolved_table_t;
+
+static tuning_entry_t entries[TUNING_MAX_ENTRIES];
+static int entries_count = 0;
+static int entries_loaded = 0;
+// Note: grows as new keys are resolved, so every key is resolved once
+static _Atomic(resolved_table_t *) resolved = NULL;
+
+static const char *type_names[] = {
+    [NORMAL] = "NORMAL",
+    [UPPER_TRIANGULAR_COLS] = "UPPER_TRIANGULAR_COLS",
+    [NORMAL_BLOCKED] = "NORMAL_BLOCKED",
+    [UPPER_TRIANGULAR_BLOCKED] = "UPPER_TRIANGULAR_BLOCKED",
+    [SPARSE_BLOCKED] = "SPARSE_BLOCKED"
+};
+
+// CPU model and cache sizes, so cache file could be shared between machines
+static const char *cpu_key(void) {
+    static char key[TUNING_KEY_SIZE / 2];
+    if (key[0]) return key;
+
+    char model[TUNING_KEY_SIZE / 4] = "unknown";
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo) {
+        char line[256];
+        while (fgets(line, sizeof(line), cpuinfo)) {
+            char *value = strchr(line, ':');
+            if (strncmp(line, "model name", 10) != 0 || !value) continue;
+            snprintf(model, sizeof(model), "%s", value + 2);
+            break;
+        }
+        fclose(cpuinfo);
+    }
+    for (char *c = model; *c; c++) {
+        if (*c == '\n') *c = '\0';
+        else if (*c == ' ' || *c == '\t') *c = '_';
+    }
+
+    snprintf(
+        key, sizeof(key), "%s/L1=%ld/L2=%ld/L3=%ld", model,
+        sysconf(_SC_LEVEL1_DCACHE_SIZE), sysconf(_SC_LEVEL2_CACHE_SIZE), sysconf(_SC_LEVEL3_CACHE_SIZE)
+    );
+    return key;
+}
+
+static void tuning_key(char *key, matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims) {
+    snprintf(
+        key, TUNING_KEY_SIZE, "%s %s*%s %s %d %d", cpu_key(), type_names[m1_type], type_names[m2_type],
+        parallel ? "omp" : "serial", dims, parallel ? matrix_pool_threads() : 1
+    );
+}
+
+static const char *cache_path(void) {
+    static char path[1024];
+    if (path[0]) return path;
+
+    const char *env = getenv(TUNING_CACHE_ENV);
+    const char *home = getenv("HOME");
+    if (env) {
+        snprintf(path, sizeof(path), "%s", env);
+    } else if (home) {
+        snprintf(path, sizeof(path), "%s/.cache/%s", home, TUNING_CACHE_FILE);
+    } else {
+        snprintf(path, sizeof(path), "%s", TUNING_CACHE_FILE);
+    }
+    return path;
+}
+
+static void entries_put(const char *key, const matrix_tuning_t *tuning) {
+    for (int i = 0; i < entries_count; i++)
+        if (strcmp(entries[i].key, key) == 0) {
+            entries[i].tuning = *tuning;
+            return;
+        }
+    if (entries_count == TUNING_MAX_ENTRIES) return;
+    snprintf(entries[entries_count].key, TUNING_KEY_SIZE, "%s", key);
+    entries[entries_count++].tuning = *tuning;
+}
+
+// Line format: <cpu> <m1 type>*<m2 type> <serial|omp> <dims> <threads> <kernel> <block size> <kc> <mc>
+// Note: later lines override earlier ones
+static void entries_load(void) {
+    entries_loaded = 1;
+    FILE *file = fopen(cache_path(), "r");
+    if (!file) return;
+
+    char cpu[TUNING_KEY_SIZE / 2], types[64], mode[16];
+    int dims, threads;
+    matrix_tuning_t tuning;
+    while (fscanf(
+        file, "%127s %63s %15s %d %d %15s %d %d %d",
+        cpu, types, mode, &dims, &threads, tuning.kernel, &tuning.block_size, &tuning.kc, &tuning.mc
+    ) == 9) {
+        char key[TUNING_KEY_SIZE];
+        snprintf(key, sizeof(key), "%s %s %s %d %d", cpu, types, mode, dims, threads);
+        entries_put(key, &tuning);
+    }
+    fclose(file);
+}
+
+// Note: must be called in matrix_tuning critical section
+static resolved_table_t *resolved_publish(int copy) {
+    resolved_table_t *table = atomic_load_explicit(&resolved, memory_order_relaxed);
+    int count = copy && table ? atomic_load_explicit(&table->count, memory_order_relaxed) : 0;
+    int capacity = !table ? 64 : copy ? 2 * table->capacity : table->capacity;
+    resolved_table_t *published = malloc(sizeof(resolved_table_t) + sizeof(resolved_kernel_t) * capacity);
+    assert(published && "could not grow resolved kernels");
+    published->capacity = capacity;
+    published->replaced = table;
+    if (count) memcpy(published->entries, table->entries, sizeof(resolved_kernel_t) * count);
+    atomic_init(&published->count, count);
+    atomic_store_explicit(&resolved, published, memory_order_release);
+    return published;
+}
+
+int matrix_tuning_lookup(matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims, matrix_tuning_t *tuning) {
+    char key[TUNING_KEY_SIZE];
+    tuning_key(key, m1_type, m2_type, parallel, dims);
+
+    int found = 0;
+    #pragma omp critical(matrix_tuning)
+    {
+        if (!entries_loaded) entries_load();
+        for (int i = 0; i < entries_count; i++)
+            if (strcmp(entries[i].key, key) == 0) {
+                *tuning = entries[i].tuning;
+                found = 1;
+                break;
+            }
+    }
+    return found;
+}
+
+void matrix_tuning_store(matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims, const matrix_tuning_t *tuning) {
+    char key[TUNING_KEY_SIZE];
+    tuning_key(key, m1_type, m2_type, parallel, dims);
+
+    #pragma omp critical(matrix_tuning)
+    {
+        if (!entries_loaded) entries_load();
+        entries_put(key, tuning);
+        resolved_publish(0);
+        if (!getenv(TUNING_CACHE_ENV) && getenv("HOME")) {
+            char dir[1024];
+            snprintf(dir, sizeof(dir), "%s/.cache", getenv("HOME"));
+            mkdir(dir, 0755);
+        }
+        FILE *file = fopen(cache_path(), "a");
+        if (file) {
+            fprintf(file, "%s %s %d %d %d\n", key, tuning->kernel, tuning->block_size, tuning->kc, tuning->mc);
+            fclose(file);
+        } else {
+            fprintf(stderr, "Could not write tuning cache %s\n", cache_path());
+        }
+    }
+}
+
+static matrix_kernel_t tuning_kernel(const matrix_tuning_t *tuning) {
+    matrix_kernel_t kernel = *matrix_kernel_select();
+    if (!matrix_kernel_named(tuning->kernel, tuning->kc, tuning->mc, &kernel))
+        fprintf(stderr, "Kernel %s from tuning cache is not supported\n", tuning->kernel);
+    return kernel;
+}
+
+matrix_kernel_t matrix_tuning_kernel(matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims) {
+    resolved_kernel_t key = {
+        .m1_type = m1_type, .m2_type = m2_type, .parallel = parallel, .dims = dims,
+        .threads = parallel ? matrix_pool_threads() : 1
+    };
+    int found = 0;
+    resolved_table_t *table = atomic_load_explicit(&resolved, memory_order_acquire);
+    int count = table ? atomic_load_explicit(&table->count, memory_order_acquire) : 0;
+    for (int i = 0; i < count; i++) {
+        resolved_kernel_t *entry = &table->entries[i];
+        if (entry->m1_type == key.m1_type && entry->m2_type == key.m2_type && entry->parallel == key.parallel
+            && entry->dims == key.dims && entry->threads == key.threads) {
+            key = *entry;
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        matrix_tuning_t tuning;
+        int tuned = matrix_tuning_lookup(m1_type, m2_type, parallel, dims, &tuning);
+        key.kernel = tuned ? tuning_kernel(&tuning) : *matrix_kernel_select();
+        // Note: the same key might be resolved concurrently, both store equal kernels
+        #pragma omp critical(matrix_tuning)
+        {
+            table = atomic_load_explicit(&resolved, memory_order_relaxed);
+            count = table ? atomic_load_explicit(&table->count, memory_order_relaxed) : 0;
+            if (!table || count == table->capacity) table = resolved_publish(1);
+            table->entries[count] = key;
+            atomic_store_explicit(&table->count, count + 1, memory_order_release);
+        }
+    }
+    return key.kernel;
+}
+
+static int is_blocked(matrix_type_t type) {
+    return type == NORMAL_BLOCKED || type == UPPER_TRIANGULAR_BLOCKED;
+}
+
+static double_matrix_t allocate_of_type(matrix_type_t type, int dims, int block_size) {
+    switch (type) {
+    case NORMAL:
+        return matrix_allocate(dims, dims);
+    case UPPER_TRIANGULAR_COLS:
+        return matrix_allocate_upper_triangular_cols(dims);
+    case NORMAL_BLOCKED:
+        return matrix_allocate_blocked(dims, block_size);
+    case UPPER_TRIANGULAR_BLOCKED:
+        return matrix_allocate_upper_triangular_blocked(dims, block_size);
+    default:
+        assert(0 && "unsupported");
+        return (double_matrix_t) { 0 };
+    }
+}
+
+typedef struct {
+    matrix_type_t m1_type;
+    matrix_type_t m2_type;
+    int parallel;
+    double_matrix_t m1_normal;
+    double_matrix_t m2_normal;
+    matrix_arena_t *arena; // matrices of every measurement, reset after it
+} tuning_problem_t;
+
+// Returns best of TUNING_RUNS times of multiplication with given configuration
+static double measure(tuning_problem_t *problem, const matrix_tuning_t *tuning) {
+    int dims = problem->m1_normal.nrows;
+    matrix_arena_t *previous_arena = matrix_arena_use(problem->arena);
+    double_matrix_t m1 = allocate_of_type(problem->m1_type, dims, tuning->block_size);
+    double_matrix_t m2 = allocate_of_type(problem->m2_type, dims, tuning->block_size);
+    matrix_type_t out_type = is_blocked(problem->m2_type) ? NORMAL_BLOCKED : NORMAL;
+    double_matrix_t out = allocate_of_type(out_type, dims, tuning->block_size);
+    matrix_convert(problem->m1_normal, m1);
+    matrix_convert(problem->m2_normal, m2);
+    // Note: candidate is passed to measured multiplication only, others keep their tuning
+    matrix_kernel_t kernel = tuning_kernel(tuning);
+
+    double best = INFINITY;
+    for (int run = 0; run < TUNING_RUNS; run++) {
+        double start = omp_get_wtime();
+        int specialized = matrix_mult_block3_specialized(
+            MATRIX_PRECISION_DOUBLE, problem->parallel, m1, m2, out, tuning->block_size, &kernel
+        );
+        assert(specialized && "tuned types have specialization");
+        (void) specialized;
+        best = MIN(best, omp_get_wtime() - start);
+    }
+
+    matrix_arena_use(previous_arena);
+    matrix_arena_reset(problem->arena);
+    return best;
+}
+
+// Tries candidate, and makes it best if it is faster
+static void try_candidate(tuning_problem_t *problem, matrix_tuning_t *best, double *best_time, matrix_tuning_t candidate) {
+    double time = measure(problem, &candidate);
+    fprintf(
+        stderr, "Tuning: kernel %s block size %d kc %d mc %d: %.3f\n",
+        candidate.kernel, candidate.block_size, candidate.kc, candidate.mc, time
+    );
+    if (time < *best_time) {
+        *best_time = time;
+        *best = candidate;
+    }
+}
+
+// Search is coordinate descent: L3 block size first, then register tile (kernel),
+// then L1 depth kc and L2 rows mc, each with other parameters fixed on the best found
+matrix_tuning_t matrix_autotune(matrix_type_t m1_type, matrix_type_t m2_type, int parallel, int dims) {
+    static const int block_sizes[] = { 16, 32, 48, 64, 80, 96, 120, 128, 160, 180, 192, 240, 256, 320, 360, 384, 480, 512 };
+    static const int kcs[] = { 0, 64, 128, 192, 256, 384 };
+    static const int mcs[] = { 0, 48, 96, 144, 192, 288 };
+
+    tuning_problem_t problem = {
+        .m1_type = m1_type,
+        .m2_type = m2_type,
+        .parallel = parallel,
+        .m1_normal = matrix_allocate(dims, dims),
+        .m2_normal = matrix_allocate(dims, dims),
+        // Note: three matrices of at most dims x dims with headers
+        .arena = matrix_arena_create(3 * (sizeof(double) * dims * dims + 2 * MATRIX_ALIGNMENT))
+    };
+    double_matrix_t m1_triangular = matrix_allocate_upper_triangular_cols(dims);
+    matrix_fill_random(m1_triangular, 0, 0);
+    matrix_fill_random(problem.m2_normal, 0, 1);
+    matrix_convert(m1_triangular, problem.m1_normal);
+    matrix_free(m1_triangular);
+
+    const matrix_kernel_t *kernel = matrix_kernel_select();
+    matrix_tuning_t best = { .block_size = MIN(dims, 128), .kc = 0, .mc = 0 };
+    snprintf(best.kernel, sizeof(best.kernel), "%s", kernel->name);
+    double best_time = INFINITY;
+
+    matrix_tuning_t candidate = best;
+    for (size_t i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++) {
+        if (block_sizes[i] > dims) break;
+        candidate.block_size = block_sizes[i];
+        try_candidate(&problem, &best, &best_time, candidate);
+    }
+    if (best_time == INFINITY) {
+        // Note: dims is smaller than every candidate, so the whole matrix is one block
+        candidate.block_size = dims;
+        try_candidate(&problem, &best, &best_time, candidate);
+    }
+
+    candidate = best;
+    const char *name;
+    for (int i = 0; (name = matrix_kernel_supported_name(i)) != NULL; i++) {
+        if (strcmp(name, best.kernel) == 0) continue;
+        snprintf(candidate.kernel, sizeof(candidate.kernel), "%s", name);
+        try_candidate(&problem, &best, &best_time, candidate);
+    }
+
+    candidate = best;
+    for (size_t i = 1; i < sizeof(kcs) / sizeof(kcs[0]); i++) {
+        if (kcs[i] >= best.block_size) break;
+        candidate.kc = kcs[i];
+        try_candidate(&problem, &best, &best_time, candidate);
+    }
+
+    candidate = best;
+    for (size_t i = 1; i < sizeof(mcs) / sizeof(mcs[0]); i++) {
+        if (mcs[i] >= best.block_size) break;
+        candidate.mc = mcs[i];
+        try_candidate(&problem, &best, &best_time, candidate);
+    }
+
+    matrix_free(problem.m1_normal);
+    matrix_free(problem.m2_normal);
+    matrix_arena_destroy(problem.arena);
+
+    matrix_tuning_store(m1_type, m2_type, parallel, dims, &best);
+    return best;
+}
@@ -0,0 +1,126 @@
+#include "matrix.h"
+
+// y = m * x, or |m| * x when absolute, rows are computed in parallel
+static void mult_vector(double_matrix_t m, const double *x, double *y, int absolute) {
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < m.nrows; i++) {
+        double sum = 0;
+        for (int j = 0; j < m.ncols; j++) {
+            double value = matrix_get_or_zero(m, i, j);
+            sum += (absolute ? fabs(value) : value) * x[j];
+        }
+        y[i] = sum;
+    }
+}
+
+int matrix_freivalds_verify(double_matrix_t m1, double_matrix_t m2, double_matrix_t out, int rounds, double tolerance) {
+    assert(m1.ncols == m2.nrows && out.nrows == m1.nrows && out.ncols == m2.ncols);
+    assert(rounds > 0);
+    double *r = malloc(sizeof(double) * m2.ncols);
+    double *m2_r = malloc(sizeof(double) * m2.nrows);
+    double *m1_m2_r = malloc(sizeof(double) * m1.nrows);
+    double *out_r = malloc(sizeof(double) * out.nrows);
+    double *bound = malloc(sizeof(double) * out.nrows);
+
+    // Note: rounding errors of row i of both sides are proportional to (|m1| |m2| 1)_i, the largest
+    // of them is used, as rows of tiny values lose everything when inputs are rounded to float
+    for (int j = 0; j < m2.ncols; j++) r[j] = 1;
+    mult_vector(m2, r, m2_r, 1);
+    mult_vector(m1, m2_r, bound, 1);
+    double max_bound = 0;
+    for (int i = 0; i < out.nrows; i++) max_bound = MAX(max_bound, bound[i]);
+
+    int ok = 1;
+    for (int round = 0; round < rounds && ok; round++) {
+        for (int j = 0; j < m2.ncols; j++) r[j] = rand() & 1 ? 1 : -1;
+        mult_vector(m2, r, m2_r, 0);
+        mult_vector(m1, m2_r, m1_m2_r, 0);
+        mult_vector(out, r, out_r, 0);
+        for (int i = 0; i < out.nrows; i++)
+            if (fabs(m1_m2_r[i] - out_r[i]) > tolerance * max_bound) {
+                printf("MATRIX NOT SAME: row %d, %.6f != %.6f in round %d\n", i, m1_m2_r[i], out_r[i], round);
+                ok = 0;
+                break;
+            }
+    }
+
+    free(r);
+    free(m2_r);
+    free(m1_m2_r);
+    free(out_r);
+    free(bound);
+    return ok;
+}
+
+// Distance of doubles in units in the last place: bits are mapped to integers ordered as doubles
+static uint64_t ulp_distance(double a, double b) {
+    int64_t a_bits, b_bits;
+    memcpy(&a_bits, &a, sizeof(a));
+    memcpy(&b_bits, &b, sizeof(b));
+    if (a_bits < 0) a_bits = INT64_MIN - a_bits;
+    if (b_bits < 0) b_bits = INT64_MIN - b_bits;
+    return a_bits > b_bits ? (uint64_t) a_bits - (uint64_t) b_bits : (uint64_t) b_bits - (uint64_t) a_bits;
+}
+
+int matrix_compare(
+    double_matrix_t expected, double_matrix_t result, double abs_tolerance, double rel_tolerance, uint64_t max_ulps
+) {
+    assert(expected.nrows == result.nrows && expected.ncols == result.ncols);
+    // Note: the worst mismatch has the largest error relative to its own allowed error
+    int mismatches = 0, worst_i = -1, worst_j = -1;
+    double worst_excess = 0;
+    #pragma omp parallel for reduction(+:mismatches) schedule(static)
+    for (int i = 0; i < result.nrows; i++)
+        for (int j = 0; j < result.ncols; j++) {
+            double value = matrix_get_or_zero(expected, i, j), result_value = matrix_get_or_zero(result, i, j);
+            double allowed = MAX(abs_tolerance, rel_tolerance * fabs(value));
+            double error = fabs(value - result_value);
+            if (error <= allowed || ulp_distance(value, result_value) <= max_ulps)
+                continue;
+            mismatches++;
+            // Note: NaN error is worse than any other
+            double excess = isnan(error) ? INFINITY : error / allowed;
+            #pragma omp critical(matrix_compare)
+            if (worst_i < 0 || excess > worst_excess) {
+                worst_excess = excess;
+                worst_i = i;
+                worst_j = j;
+            }
+        }
+    if (mismatches > 0)
+        printf(
+            "MATRIX NOT SAME: %d elements, the worst (%d, %d) %.6f != %.6f\n", mismatches, worst_i, worst_j,
+            matrix_get_or_zero(expected, worst_i, worst_j), matrix_get_or_zero(result, worst_i, worst_j)
+        );
+    return mismatches == 0;
+}
+
+void matrix_reference_mult3(double_matrix_t m1, double_matrix_t m2, double_matrix_t out) {
+    assert(out.nrows == m1.nrows && out.ncols == m2.ncols && m1.ncols == m2.nrows);
+    assert(m1.type == NORMAL && m2.type == NORMAL && out.type == NORMAL);
+    const double *a = m1.data, *b = m2.data;
+    double *c = (double *) out.data;
+    int b_rs, b_cs, c_rs, c_cs;
+    matrix_normal_strides(m2, &b_rs, &b_cs);
+    matrix_normal_strides(out, &c_rs, &c_cs);
+
+    // Note: i-k-j order, so inner loop streams rows of m2 and out and is vectorized
+    // (for row-major ones, views might have other strides)
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < out.nrows; i++) {
+        double *c_row = c + (size_t) i * c_rs;
+        for (int j = 0; j < out.ncols; j++)
+            c_row[(size_t) j * c_cs] = 0;
+        for (int k = 0; k < m1.ncols; k++) {
+            double a_ik = a[matrix_normal_offset(m1, i, k)];
+            const double *b_row = b + (size_t) k * b_rs;
+            if (b_cs == 1 && c_cs == 1) {
+                for (int j = 0; j < out.ncols; j++)
+                    c_row[j] += a_ik * b_row[j];
+            } else {
+                for (int j = 0; j < out.ncols; j++)
+                    c_row[(size_t) j * c_cs] += a_ik * b_row[(size_t) j * b_cs];
+            }
+        }
+    }
+}
@@ -32,3 +32,236 @@ for seed in `seq 0 1 10`; do
         echo "Test $seed passed: $retVal"
     fi
 done
+
+echo "Verification of algorithm 5"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 5 -d 512 -b 16
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 6"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 6 -d 512 -b 16 -r 64
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Exact verification of algorithm 5"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 5 -d 512 -b 16 -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 7"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 7 -d 128 -b 32 -m 16
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 4 in single precision"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 4 -d 512 -p float
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 5 in mixed precision"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 5 -d 512 -b 16 -p mixed
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 8"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 8 -d 512 -b 16 -o 1
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 9"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 9 -d 500 -b 64
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 10"
+for seed in `seq 0 1 10`; do
+    OMP_NUM_THREADS=2 ./build/experiment -s $seed -a 10 -d 300 -m 4 -b 64 -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 10 with dense and triangular B of the same shape"
+for seed in `seq 0 1 10`; do
+    OMP_NUM_THREADS=2 ./build/experiment -s $seed -a 10 -d 300 -m 8 -b 64 -M
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 11"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 11 -d 500 -b 64 -q $((seed % 3)) -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 12"
+for seed in `seq 0 1 10`; do
+    ./build/experiment -s $seed -a 12 -d 333 -b 64 -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of algorithm 13"
+for seed in `seq 0 1 10`; do
+    OMP_NUM_THREADS=2 ./build/experiment -s $seed -a 13 -d 333 -l $((200 + 17 * seed)) -b 64 -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of non-divisible and rectangular shapes"
+for algorithm in 2 3 4 5 9; do
+    ./build/experiment -s $algorithm -a $algorithm -d 333 -l 517 -b 64 -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $algorithm failed"
+    else
+        echo "Test $algorithm passed: $retVal"
+    fi
+done
+
+echo "Verification of TRMM variants and GEMM with beta"
+for variant in "-a 9 -e l" "-a 9 -e t" "-a 9 -e lt" "-a 9 -e u" "-a 9 -e ltu -g 2.5" "-a 9 -g -0.5" "-a 15" "-a 15 -g 2.5"; do
+    ./build/experiment -s 1 $variant -d 333 -l 517 -b 64 -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $variant failed"
+    else
+        echo "Test $variant passed: $retVal"
+    fi
+done
+
+echo "Verification of GEMM with inner dimension of one"
+./build/experiment -s 1 -a 15 -d 1 -l 7 -g 2.5 -v exact
+retVal=$?
+if [ $retVal -ne 0 ]; then
+    echo "Test -a 15 -d 1 failed"
+else
+    echo "Test -a 15 -d 1 passed: $retVal"
+fi
+
+echo "Verification of rectangular shapes in single and mixed precision"
+for precision in float mixed; do
+    for algorithm in 2 3 4 5; do
+        ./build/experiment -s $algorithm -a $algorithm -d 333 -l 517 -b 64 -p $precision -v exact
+        retVal=$?
+        if [ $retVal -ne 0 ]; then
+            echo "Test $algorithm failed"
+        else
+            echo "Test $algorithm passed: $retVal"
+        fi
+    done
+done
+
+echo "Verification of repeated Strassen-Winograd products taken from arena"
+for seed in `seq 0 1 3`; do
+    ./build/experiment -s $seed -a 14 -d 1024 -b 64 -r 128 -m 8 -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $seed failed"
+    else
+        echo "Test $seed passed: $retVal"
+    fi
+done
+
+echo "Verification of pool with oversubscribed pinned workers"
+for algorithm in 4 5; do
+    OMP_NUM_THREADS=4 ./build/experiment -s $algorithm -a $algorithm -d 1000 -b 80 -P -v exact
+    retVal=$?
+    if [ $retVal -ne 0 ]; then
+        echo "Test $algorithm failed"
+    else
+        echo "Test $algorithm passed: $retVal"
+    fi
+done
+
+if command -v mpirun > /dev/null; then
+    make mpi
+    echo "Verification of distributed multiplication"
+    for ranks in `seq 1 1 4`; do
+        mpirun --oversubscribe -np $ranks ./build/experiment_mpi -s $ranks -d 512 -b 32
+        retVal=$?
+        if [ $retVal -ne 0 ]; then
+            echo "Test $ranks failed"
+        else
+            echo "Test $ranks passed: $retVal"
+        fi
+    done
+    echo "Verification of distributed multiplication with padded blocks and gather"
+    for ranks in `seq 1 1 4`; do
+        mpirun --oversubscribe -np $ranks ./build/experiment_mpi -s $ranks -d 500 -b 32 -g
+        retVal=$?
+        if [ $retVal -ne 0 ]; then
+            echo "Test $ranks failed"
+        else
+            echo "Test $ranks passed: $retVal"
+        fi
+    done
+fi